@@ -4,51 +4,28 @@
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <cstdlib>
 #include <iostream>
 #include <map>
+#include <optional>
 #include <stdexcept>
+#include <thread>
 #include <vector>
 
+#include "instance_capabilities.hpp"
+#include "metrics.hpp"
+#include "triple_buffer.hpp"
+#include "vk_result.hpp"
+
 struct Size {
     int width;
     int height;
 };
 
-std::string vk_result_error_message(VkResult errorCode)
-{
-    switch (errorCode)
-    {
-#define STR(r) case VK_ ##r: return #r
-        STR(NOT_READY);
-        STR(TIMEOUT);
-        STR(EVENT_SET);
-        STR(EVENT_RESET);
-        STR(INCOMPLETE);
-        STR(ERROR_OUT_OF_HOST_MEMORY);
-        STR(ERROR_OUT_OF_DEVICE_MEMORY);
-        STR(ERROR_INITIALIZATION_FAILED);
-        STR(ERROR_DEVICE_LOST);
-        STR(ERROR_MEMORY_MAP_FAILED);
-        STR(ERROR_LAYER_NOT_PRESENT);
-        STR(ERROR_EXTENSION_NOT_PRESENT);
-        STR(ERROR_FEATURE_NOT_PRESENT);
-        STR(ERROR_INCOMPATIBLE_DRIVER);
-        STR(ERROR_TOO_MANY_OBJECTS);
-        STR(ERROR_FORMAT_NOT_SUPPORTED);
-        STR(ERROR_SURFACE_LOST_KHR);
-        STR(ERROR_NATIVE_WINDOW_IN_USE_KHR);
-        STR(SUBOPTIMAL_KHR);
-        STR(ERROR_OUT_OF_DATE_KHR);
-        STR(ERROR_INCOMPATIBLE_DISPLAY_KHR);
-        STR(ERROR_VALIDATION_FAILED_EXT);
-        STR(ERROR_INVALID_SHADER_NV);
-#undef STR
-        default:
-        return "UNKNOWN_ERROR";
-    }
-}
-
 // Validation Layers
 #ifdef NDEBUG
 constexpr auto enable_validation_layers = false;
@@ -60,43 +37,42 @@ const std::vector<const char*> validation_layers = {
     "VK_LAYER_KHRONOS_validation",
 };
 
-auto check_validation_layer_support() {
-    auto layer_count = uint32_t{0};
-    vkEnumerateInstanceLayerProperties(&layer_count, nullptr);
-
-    auto available_layers = std::vector<VkLayerProperties>(layer_count);
-    vkEnumerateInstanceLayerProperties(&layer_count, available_layers.data());
-
-    for (const auto& layer_name : validation_layers) {
-        auto found = false;
-
-        for (const auto& layer_properties : available_layers) {
-            if (std::string{layer_name} == layer_properties.layerName) {
-                found = true;
-                break;
-            }
-        }
+// Validation messages by severity, fed to debug_callback via pUserData.
+using ValidationCounters = std::array<metrics::Counter*, 4>;
 
-        if (not found) {
-            return false;
-        }
+auto severity_index(VkDebugUtilsMessageSeverityFlagBitsEXT severity) -> size_t {
+    switch (severity) {
+        case VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT: return 0;
+        case VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT: return 1;
+        case VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT: return 2;
+        default: return 3;
     }
-
-    return true;
 }
 
 // Message callbacks
-auto get_required_extensions() {
+// GLFW's surface extensions are the only hard requirement. Validation and
+// debug utils are wanted in debug builds but skipped when not installed;
+// get_physical_device_properties2 is needed to query the memory budget on a
+// 1.0 instance, and portability enumeration to see MoltenVK-style drivers.
+auto get_instance_request() {
     auto glfw_extension_count = uint32_t{0};
     auto glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_extension_count);
 
-    auto extensions = std::vector<const char*>(glfw_extensions, glfw_extensions + glfw_extension_count);
+    auto request = InstanceRequest{};
+    request.required_extensions.assign(glfw_extensions, glfw_extensions + glfw_extension_count);
+    request.optional_extensions = {
+        VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME,
+    };
+#ifdef VK_KHR_portability_enumeration
+    request.optional_extensions.push_back(VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME);
+#endif
 
     if (enable_validation_layers) {
-        extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+        request.optional_layers = validation_layers;
+        request.optional_extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
     }
 
-    return extensions;
+    return request;
 }
 
 static VKAPI_ATTR auto VKAPI_CALL debug_callback(
@@ -105,6 +81,10 @@ static VKAPI_ATTR auto VKAPI_CALL debug_callback(
         const VkDebugUtilsMessengerCallbackDataEXT* callback_data,
         void* data
 ) -> VkBool32 {
+    if (data) {
+        (*static_cast<ValidationCounters*>(data))[severity_index(severity)]->add();
+    }
+
     std::cerr << "Validation layer: " << callback_data->pMessage << std::endl;
 
     return VK_FALSE;
@@ -143,12 +123,161 @@ auto destroy_debug_utils_messenger(
     }
 }
 
+// API versions and device features
+// Newest API version this code knows how to use. A 1.0 loader rejects any
+// newer apiVersion with VK_ERROR_INCOMPATIBLE_DRIVER, so the requested
+// version is clamped to what the loader (and later the device) reports.
+// Headers older than 1.3 (e.g. Ubuntu 22.04's) cap it at 1.2, and the 1.3
+// feature queries below are compiled out with it.
+#ifdef VK_VERSION_1_3
+constexpr auto MAX_API_VERSION = VK_API_VERSION_1_3;
+#else
+constexpr auto MAX_API_VERSION = VK_API_VERSION_1_2;
+#endif
+
+auto clamp_api_version(uint32_t version) {
+    auto major_minor = VK_MAKE_API_VERSION(0, VK_API_VERSION_MAJOR(version), VK_API_VERSION_MINOR(version), 0);
+    return std::min<uint32_t>(major_minor, MAX_API_VERSION);
+}
+
+auto api_version_string(uint32_t version) {
+    return std::to_string(VK_API_VERSION_MAJOR(version)) + '.'
+           + std::to_string(VK_API_VERSION_MINOR(version)) + '.'
+           + std::to_string(VK_API_VERSION_PATCH(version));
+}
+
+// Preference order for physical device types, higher is better.
+auto device_type_rank(VkPhysicalDeviceType type) {
+    switch (type) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: return 4;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return 3;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: return 2;
+        case VK_PHYSICAL_DEVICE_TYPE_CPU: return 1;
+        default: return 0;
+    }
+}
+
+// Fast paths that depend on 1.2/1.3 core features. Everything stays false
+// on a 1.0/1.1 device, and callers must keep a path that works without them.
+struct DeviceFeatureSupport {
+    uint32_t api_version = VK_API_VERSION_1_0;
+    bool timeline_semaphore = false;
+    bool buffer_device_address = false;
+    bool descriptor_indexing = false;
+    bool synchronization2 = false;
+    bool dynamic_rendering = false;
+};
+
+auto query_device_features(VkInstance instance, VkPhysicalDevice device, uint32_t api_version) {
+    auto support = DeviceFeatureSupport{};
+    support.api_version = api_version;
+
+    if (api_version < VK_API_VERSION_1_2) {
+        return support;
+    }
+
+    // Loaded through the instance so a 1.0 loader doesn't fail to link.
+    auto get_features2 = load_vk_function<PFN_vkGetPhysicalDeviceFeatures2>(instance, "vkGetPhysicalDeviceFeatures2");
+    if (not get_features2) {
+        return support;
+    }
+
+#ifdef VK_VERSION_1_3
+    auto features13 = VkPhysicalDeviceVulkan13Features{
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES,
+    };
+#endif
+    auto features12 = VkPhysicalDeviceVulkan12Features{
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+    };
+#ifdef VK_VERSION_1_3
+    if (api_version >= VK_API_VERSION_1_3) {
+        features12.pNext = &features13;
+    }
+#endif
+    auto features = VkPhysicalDeviceFeatures2{
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+        .pNext = &features12,
+    };
+
+    get_features2(device, &features);
+
+    support.timeline_semaphore = features12.timelineSemaphore;
+    support.buffer_device_address = features12.bufferDeviceAddress;
+    support.descriptor_indexing = features12.descriptorIndexing;
+#ifdef VK_VERSION_1_3
+    support.synchronization2 = features13.synchronization2;
+    support.dynamic_rendering = features13.dynamicRendering;
+#endif
+
+    return support;
+}
+
+// Simulation
+using Clock = std::chrono::steady_clock;
+
+struct SimulationState {
+    uint64_t tick;
+    double time;
+    Clock::time_point published_at;
+    Clock::time_point input_time;
+};
+
+auto interpolate(const SimulationState& previous, const SimulationState& current, double alpha) {
+    auto state = current;
+    state.time = previous.time + (current.time - previous.time) * alpha;
+    return state;
+}
+
+// Command line
+struct Options {
+    std::string metrics_destination;
+    uint64_t frame_limit = 0;
+    bool verbose = false;
+};
+
+auto parse_options(int argc, char* argv[]) {
+    auto options = Options{};
+
+    for (auto i = 1; i < argc; ++i) {
+        auto arg = std::string{argv[i]};
+
+        if (arg == "--metrics" and i + 1 < argc) {
+            options.metrics_destination = argv[++i];
+        } else if (arg == "--frames" and i + 1 < argc) {
+            // Exit after a fixed number of frames, for scripted runs such as
+            // PGO training.
+            auto value = std::string{argv[++i]};
+            auto parsed = size_t{0};
+            try {
+                options.frame_limit = std::stoull(value, &parsed);
+            } catch (const std::exception&) {
+                parsed = 0;
+            }
+            if (parsed == 0 or parsed != value.size() or value[0] == '-') {
+                throw std::runtime_error("Invalid --frames value: " + value);
+            }
+        } else if (arg == "--verbose") {
+            options.verbose = true;
+        } else {
+            throw std::runtime_error("Unknown argument: " + arg);
+        }
+    }
+
+    return options;
+}
+
 
 class HelloTriangleApp {
 public:
+    explicit HelloTriangleApp(Options options):
+        options{std::move(options)}
+    {}
+
     void run() {
         init_window();
         init_vulkan();
+        start_metrics_export();
         main_loop();
         cleanup();
     }
@@ -165,76 +294,162 @@ private:
                                   "Vulkan",
                                   nullptr,
                                   nullptr);
+
+        glfwSetWindowUserPointer(window, this);
+        glfwSetKeyCallback(window, key_callback);
+        glfwSetMouseButtonCallback(window, mouse_button_callback);
+        glfwSetCursorPosCallback(window, cursor_pos_callback);
+    }
+
+    static void key_callback(GLFWwindow* window, int, int, int, int) {
+        get_app(window)->record_input();
+    }
+
+    static void mouse_button_callback(GLFWwindow* window, int, int, int) {
+        get_app(window)->record_input();
+    }
+
+    static void cursor_pos_callback(GLFWwindow* window, double, double) {
+        get_app(window)->record_input();
+    }
+
+    static auto get_app(GLFWwindow* window) -> HelloTriangleApp* {
+        return static_cast<HelloTriangleApp*>(glfwGetWindowUserPointer(window));
+    }
+
+    // Input callbacks fire from glfwPollEvents(), so this timestamp is taken
+    // as the event is polled. Only the oldest input not yet seen by the
+    // simulation is kept: that is the one whose latency is the worst.
+    void record_input() {
+        auto expected = Clock::rep{0};
+        auto now = Clock::now().time_since_epoch().count();
+        pending_input.compare_exchange_strong(expected, now, std::memory_order_relaxed);
     }
 
     void init_vulkan() {
         create_instance();
         setup_debug_messenger();
+        pick_physical_device();
     }
 
     void create_instance() {
-        if (enable_validation_layers and not check_validation_layer_support()) {
-            throw std::runtime_error("Validation layers requested but not supported");
+        auto capabilities = get_instance_capabilities();
+        instance_api_version = clamp_api_version(capabilities.loader_version);
+        auto request = get_instance_request();
+        enabled_instance = negotiate_instance_set(capabilities, request);
+
+        // A stale cache must not turn into a hard failure: re-probe first.
+        // A validation layer installed since the cache was written changes
+        // the manifest directory times in its key, so it is seen anyway.
+        if (not enabled_instance.missing_required.empty() and capabilities.from_cache) {
+            capabilities = get_instance_capabilities(false);
+            enabled_instance = negotiate_instance_set(capabilities, request);
+        }
+
+        if (not enabled_instance.missing_required.empty()) {
+            throw std::runtime_error(std::string{"Required instance layer or extension not supported: "}
+                                     + enabled_instance.missing_required.front());
+        }
+
+        if (options.verbose) {
+            print_instance_capabilities(capabilities);
         }
 
+        auto result = try_create_instance();
+
+        if ((result == VK_ERROR_LAYER_NOT_PRESENT or result == VK_ERROR_EXTENSION_NOT_PRESENT)
+            and capabilities.from_cache) {
+            capabilities = get_instance_capabilities(false);
+            enabled_instance = negotiate_instance_set(capabilities, request);
+            result = try_create_instance();
+        }
+
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create vulkan instance: " + vk_result_error_message(result));
+        }
+
+        if (options.verbose) {
+            print_enabled_instance_set();
+        }
+    }
+
+    auto try_create_instance() -> VkResult {
         auto app_info = VkApplicationInfo{
             .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
             .pApplicationName = "Hello Triangle",
             .applicationVersion = VK_MAKE_VERSION(1, 0, 0),
             .pEngineName = "No Engine",
             .engineVersion = VK_MAKE_VERSION(0, 0, 1),
-            .apiVersion = VK_API_VERSION_1_0,
+            .apiVersion = instance_api_version,
         };
 
         auto instance_info = VkInstanceCreateInfo{
             .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
             .pApplicationInfo = &app_info,
+            .enabledLayerCount = static_cast<uint32_t>(enabled_instance.layers.size()),
+            .ppEnabledLayerNames = enabled_instance.layers.data(),
+            .enabledExtensionCount = static_cast<uint32_t>(enabled_instance.extensions.size()),
+            .ppEnabledExtensionNames = enabled_instance.extensions.data(),
         };
 
-        if (enable_validation_layers) {
-            auto extensions = get_required_extensions();
-            instance_info.enabledLayerCount = static_cast<uint32_t>(extensions.size());
-            instance_info.ppEnabledExtensionNames = extensions.data();
+#ifdef VK_KHR_portability_enumeration
+        if (enabled_instance.has_extension(VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME)) {
+            instance_info.flags |= VK_INSTANCE_CREATE_ENUMERATE_PORTABILITY_BIT_KHR;
         }
+#endif
 
-        auto glfw_extension_count = uint32_t{0};
-        const auto glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_extension_count);
+        return vkCreateInstance(&instance_info, nullptr, &instance);
+    }
 
-        instance_info.enabledExtensionCount = glfw_extension_count;
-        instance_info.ppEnabledExtensionNames = glfw_extensions;
+    void print_enabled_instance_set() {
+        std::cout << "Enabled layers:\n";
+        for (auto layer: enabled_instance.layers) {
+            std::cout << "    :: " << layer << '\n';
+        }
 
-        instance_info.enabledLayerCount = 0;
+        std::cout << "Enabled extensions:\n";
+        for (auto extension: enabled_instance.extensions) {
+            std::cout << "    :: " << extension << '\n';
+        }
 
-        if (auto result = vkCreateInstance(&instance_info, nullptr, &instance)) {
-            throw std::runtime_error("Failed to create vulkan instance: " + vk_result_error_message(result));
+        std::cout << "Skipped (not available):\n";
+        for (auto name: enabled_instance.missing_optional) {
+            std::cout << "    :: " << name << '\n';
         }
+    }
 
-        auto extension_count = uint32_t{0};
-        vkEnumerateInstanceExtensionProperties(nullptr, &extension_count, nullptr);
-        auto extensions = std::vector<VkExtensionProperties>(extension_count);
-        vkEnumerateInstanceExtensionProperties(nullptr, &extension_count, extensions.data());
+    void print_instance_capabilities(const InstanceCapabilities& capabilities) {
+        std::cout << "Loader version: " << api_version_string(capabilities.loader_version)
+                  << (capabilities.from_cache ? " (cached)" : "") << '\n'
+                  << "Requested API version: " << api_version_string(instance_api_version) << '\n';
+
+        std::cout << "Available layers:\n";
+        for (const auto& layer: capabilities.layers) {
+            std::cout << "    :: " << layer << '\n';
+        }
 
         std::cout << "Available extensions:\n";
-        for (const auto& extension: extensions) {
-            std::cout << "    :: " << extension.extensionName << '\n';
+        for (const auto& extension: capabilities.extensions) {
+            std::cout << "    :: " << extension << '\n';
         }
     }
 
     void setup_debug_messenger() {
-        if (not enable_validation_layers) {
+        if (not enabled_instance.has_extension(VK_EXT_DEBUG_UTILS_EXTENSION_NAME)) {
             return;
         }
 
         auto create_info = VkDebugUtilsMessengerCreateInfoEXT{
             .sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT,
             .messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT
+                               | VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT
                                | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT
                                | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT,
             .messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT
                            | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT
                            | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT,
             .pfnUserCallback = debug_callback,
-            .pUserData = nullptr,
+            .pUserData = &validation_messages,
         };
 
         if (auto r = create_debug_utils_messenger_ext(instance, &create_info, nullptr, &debug_messenger);
@@ -244,14 +459,156 @@ private:
         }
     }
 
+    // Prefer discrete over integrated over virtual over CPU devices; among
+    // devices of the same type, prefer the newest usable API version.
+    void pick_physical_device() {
+        auto device_count = uint32_t{0};
+        vkEnumeratePhysicalDevices(instance, &device_count, nullptr);
+
+        if (device_count == 0) {
+            throw std::runtime_error("Failed to find GPUs with Vulkan support");
+        }
+
+        auto devices = std::vector<VkPhysicalDevice>(device_count);
+        vkEnumeratePhysicalDevices(instance, &device_count, devices.data());
+
+        auto best_score = std::pair<int, uint32_t>{0, 0};
+        auto best_properties = VkPhysicalDeviceProperties{};
+
+        for (auto device: devices) {
+            auto properties = VkPhysicalDeviceProperties{};
+            vkGetPhysicalDeviceProperties(device, &properties);
+
+            auto score = std::make_pair(device_type_rank(properties.deviceType),
+                                        std::min(clamp_api_version(properties.apiVersion), instance_api_version));
+
+            if (physical_device == VK_NULL_HANDLE or score > best_score) {
+                physical_device = device;
+                best_score = score;
+                best_properties = properties;
+            }
+        }
+
+        device_features = query_device_features(instance, physical_device, best_score.second);
+
+        if (options.verbose) {
+            std::cout << "Physical device: " << best_properties.deviceName
+                      << " (Vulkan " << api_version_string(best_properties.apiVersion)
+                      << ", using " << api_version_string(device_features.api_version) << ")\n"
+                      << "    :: timeline semaphores: " << device_features.timeline_semaphore << '\n'
+                      << "    :: buffer device address: " << device_features.buffer_device_address << '\n'
+                      << "    :: descriptor indexing: " << device_features.descriptor_indexing << '\n'
+                      << "    :: synchronization2: " << device_features.synchronization2 << '\n'
+                      << "    :: dynamic rendering: " << device_features.dynamic_rendering << '\n';
+        }
+    }
+
     void main_loop() {
-        while (not glfwWindowShouldClose(window)) {
+        start_simulation();
+
+        auto previous = SimulationState{};
+        auto current = SimulationState{};
+        auto frame_start = Clock::now();
+        auto frame_count = uint64_t{0};
+
+        while (not glfwWindowShouldClose(window)
+               and (options.frame_limit == 0 or frame_count++ < options.frame_limit)) {
+            auto now = Clock::now();
+            frames.add();
+            frame_time.record(now - frame_start);
+            frame_start = now;
+
             glfwPollEvents();
+
+            if (snapshots.update()) {
+                previous = current;
+                current = snapshots.front();
+
+                if (current.input_time != previous.input_time) {
+                    input_latency.record(Clock::now() - current.input_time);
+                }
+            }
+
+            auto since_publish = std::chrono::duration<double>(Clock::now() - current.published_at);
+            auto alpha = std::clamp(since_publish / SIMULATION_STEP, 0.0, 1.0);
+            render_state = interpolate(previous, current, alpha);
+        }
+
+        stop_simulation();
+        report_input_latency();
+    }
+
+    // Measured from event poll until the render loop picks up the first
+    // simulation snapshot that consumed the input.
+    void report_input_latency() {
+        auto latency = input_latency.snapshot();
+        if (latency.count == 0) {
+            return;
+        }
+
+        auto ms = [&](double p) { return static_cast<double>(latency.percentile(p)) / 1000.0; };
+        std::cout << "Input latency (ms) over " << latency.count << " events:"
+                  << " p50=" << ms(0.50)
+                  << " p90=" << ms(0.90)
+                  << " p99=" << ms(0.99)
+                  << " max=" << ms(1.00)
+                  << '\n';
+    }
+
+    void start_metrics_export() {
+        if (options.metrics_destination.empty()) {
+            return;
+        }
+
+        metrics_exporter.emplace(registry, options.metrics_destination, METRICS_EXPORT_PERIOD);
+    }
+
+    void start_simulation() {
+        simulation_running = true;
+        simulation_thread = std::thread{[this] { simulation_loop(); }};
+    }
+
+    void stop_simulation() {
+        simulation_running = false;
+
+        if (simulation_thread.joinable()) {
+            simulation_thread.join();
+        }
+    }
+
+    void simulation_loop() {
+        auto state = SimulationState{};
+        auto next_tick = Clock::now();
+
+        while (simulation_running) {
+            state.tick += 1;
+            simulation_ticks.add();
+            state.time += SIMULATION_STEP.count();
+            state.published_at = Clock::now();
+
+            if (auto input = pending_input.exchange(0, std::memory_order_relaxed)) {
+                state.input_time = Clock::time_point{Clock::duration{input}};
+            }
+
+            snapshots.back() = state;
+            snapshots.publish();
+
+            next_tick += std::chrono::duration_cast<Clock::duration>(SIMULATION_STEP);
+
+            // Don't try to catch up after a long stall (e.g. debugger break);
+            // drop the missed ticks instead of spinning through them.
+            if (auto now = Clock::now(); next_tick < now - MAX_SIMULATION_LAG) {
+                next_tick = now;
+            }
+
+            std::this_thread::sleep_until(next_tick);
         }
     }
 
     void cleanup() {
-        if (enable_validation_layers) {
+        metrics_exporter.reset();
+
+        if (debug_messenger != VK_NULL_HANDLE) {
             destroy_debug_utils_messenger(instance, debug_messenger, nullptr);
         }
 
@@ -262,17 +619,45 @@ private:
     }
 
     constexpr static auto DEFAULT_SIZE = Size{800, 600};
+    constexpr static auto SIMULATION_STEP = std::chrono::duration<double>{1.0 / 60.0};
+    constexpr static auto MAX_SIMULATION_LAG = std::chrono::milliseconds{250};
+    constexpr static auto METRICS_EXPORT_PERIOD = std::chrono::milliseconds{1000};
+
+    Options options;
 
     GLFWwindow* window;
     VkInstance instance;
-    VkDebugUtilsMessengerEXT debug_messenger;
+    uint32_t instance_api_version = VK_API_VERSION_1_0;
+    EnabledInstanceSet enabled_instance;
+    VkDebugUtilsMessengerEXT debug_messenger = VK_NULL_HANDLE;
+    VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+    DeviceFeatureSupport device_features;
+
+    TripleBuffer<SimulationState> snapshots;
+    std::atomic<bool> simulation_running{false};
+    std::thread simulation_thread;
+    SimulationState render_state;
+
+    std::atomic<Clock::rep> pending_input{0};
+
+    metrics::Registry registry;
+    metrics::Counter& frames = registry.counter("frames");
+    metrics::Histogram& frame_time = registry.histogram("frame_time_us");
+    metrics::Histogram& input_latency = registry.histogram("input_latency_us");
+    metrics::Counter& simulation_ticks = registry.counter("simulation_ticks");
+    ValidationCounters validation_messages = {
+        &registry.counter("validation_messages.verbose"),
+        &registry.counter("validation_messages.info"),
+        &registry.counter("validation_messages.warning"),
+        &registry.counter("validation_messages.error"),
+    };
+    std::optional<metrics::Exporter> metrics_exporter;
 };
 
 
-int main() {
-    auto app = HelloTriangleApp{};
-
+int main(int argc, char* argv[]) {
     try {
+        auto app = HelloTriangleApp{parse_options(argc, argv)};
         app.run();
     } catch (const std::exception& e) {
         std::cerr << e.what() << std::endl;
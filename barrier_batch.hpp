@@ -0,0 +1,486 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+// How a pass uses a resource, in synchronization2 terms. The layout only
+// matters for images.
+struct ResourceAccess {
+    VkPipelineStageFlags2KHR stages = VK_PIPELINE_STAGE_2_NONE_KHR;
+    VkAccessFlags2KHR access = VK_ACCESS_2_NONE_KHR;
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    friend auto operator==(const ResourceAccess& a, const ResourceAccess& b) {
+        return a.stages == b.stages and a.access == b.access and a.layout == b.layout;
+    }
+
+    friend auto operator!=(const ResourceAccess& a, const ResourceAccess& b) {
+        return not (a == b);
+    }
+};
+
+// vkCmdPipelineBarrier only knows the original 32 stage and access bits.
+// The synchronization2-only bits map to the legacy bit that covers them.
+inline auto legacy_stage_mask(VkPipelineStageFlags2KHR stages) {
+    constexpr auto TRANSFER_STAGES = VkPipelineStageFlags2KHR{
+            VK_PIPELINE_STAGE_2_COPY_BIT_KHR | VK_PIPELINE_STAGE_2_RESOLVE_BIT_KHR
+            | VK_PIPELINE_STAGE_2_BLIT_BIT_KHR | VK_PIPELINE_STAGE_2_CLEAR_BIT_KHR};
+    constexpr auto VERTEX_INPUT_STAGES = VkPipelineStageFlags2KHR{
+            VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT_KHR | VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT_KHR};
+    constexpr auto KNOWN_STAGES = VkPipelineStageFlags2KHR{
+            0xffffffffull | TRANSFER_STAGES | VERTEX_INPUT_STAGES
+            | VK_PIPELINE_STAGE_2_PRE_RASTERIZATION_SHADERS_BIT_KHR};
+
+    auto legacy = static_cast<VkPipelineStageFlags>(stages & 0xffffffffull);
+
+    if (stages & TRANSFER_STAGES) {
+        legacy |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+    }
+    if (stages & VERTEX_INPUT_STAGES) {
+        legacy |= VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+    }
+    if (stages & VK_PIPELINE_STAGE_2_PRE_RASTERIZATION_SHADERS_BIT_KHR) {
+        legacy |= VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT;
+    }
+    if (stages & ~KNOWN_STAGES) {
+        legacy |= VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    }
+
+    return legacy;
+}
+
+inline auto legacy_access_mask(VkAccessFlags2KHR access) {
+    constexpr auto SHADER_READS = VkAccessFlags2KHR{
+            VK_ACCESS_2_SHADER_SAMPLED_READ_BIT_KHR | VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR};
+    constexpr auto KNOWN_ACCESS = VkAccessFlags2KHR{
+            0xffffffffull | SHADER_READS | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR};
+
+    auto legacy = static_cast<VkAccessFlags>(access & 0xffffffffull);
+
+    if (access & SHADER_READS) {
+        legacy |= VK_ACCESS_SHADER_READ_BIT;
+    }
+    if (access & VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR) {
+        legacy |= VK_ACCESS_SHADER_WRITE_BIT;
+    }
+    if (access & ~KNOWN_ACCESS) {
+        legacy |= VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+    }
+
+    return legacy;
+}
+
+struct PipelineBarriers {
+    std::vector<VkImageMemoryBarrier2KHR> images;
+    std::vector<VkBufferMemoryBarrier2KHR> buffers;
+
+    auto empty() const {
+        return images.empty() and buffers.empty();
+    }
+};
+
+// Records all barriers as one command: vkCmdPipelineBarrier2 when the device
+// has synchronization2 (see DeviceFeatureSupport), otherwise one legacy
+// vkCmdPipelineBarrier, whose single stage mask pair is the union of all of
+// them.
+inline void record_pipeline_barriers(VkCommandBuffer command_buffer,
+                                     const PipelineBarriers& barriers,
+                                     PFN_vkCmdPipelineBarrier2KHR pipeline_barrier2) {
+    if (barriers.empty()) {
+        return;
+    }
+
+    if (pipeline_barrier2) {
+        auto dependency = VkDependencyInfoKHR{
+            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR,
+            .bufferMemoryBarrierCount = static_cast<uint32_t>(barriers.buffers.size()),
+            .pBufferMemoryBarriers = barriers.buffers.data(),
+            .imageMemoryBarrierCount = static_cast<uint32_t>(barriers.images.size()),
+            .pImageMemoryBarriers = barriers.images.data(),
+        };
+        pipeline_barrier2(command_buffer, &dependency);
+        return;
+    }
+
+    auto src_stages = VkPipelineStageFlags{0};
+    auto dst_stages = VkPipelineStageFlags{0};
+
+    auto images = std::vector<VkImageMemoryBarrier>{};
+    images.reserve(barriers.images.size());
+    for (const auto& barrier: barriers.images) {
+        src_stages |= legacy_stage_mask(barrier.srcStageMask);
+        dst_stages |= legacy_stage_mask(barrier.dstStageMask);
+        images.push_back(VkImageMemoryBarrier{
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = legacy_access_mask(barrier.srcAccessMask),
+            .dstAccessMask = legacy_access_mask(barrier.dstAccessMask),
+            .oldLayout = barrier.oldLayout,
+            .newLayout = barrier.newLayout,
+            .srcQueueFamilyIndex = barrier.srcQueueFamilyIndex,
+            .dstQueueFamilyIndex = barrier.dstQueueFamilyIndex,
+            .image = barrier.image,
+            .subresourceRange = barrier.subresourceRange,
+        });
+    }
+
+    auto buffers = std::vector<VkBufferMemoryBarrier>{};
+    buffers.reserve(barriers.buffers.size());
+    for (const auto& barrier: barriers.buffers) {
+        src_stages |= legacy_stage_mask(barrier.srcStageMask);
+        dst_stages |= legacy_stage_mask(barrier.dstStageMask);
+        buffers.push_back(VkBufferMemoryBarrier{
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+            .srcAccessMask = legacy_access_mask(barrier.srcAccessMask),
+            .dstAccessMask = legacy_access_mask(barrier.dstAccessMask),
+            .srcQueueFamilyIndex = barrier.srcQueueFamilyIndex,
+            .dstQueueFamilyIndex = barrier.dstQueueFamilyIndex,
+            .buffer = barrier.buffer,
+            .offset = barrier.offset,
+            .size = barrier.size,
+        });
+    }
+
+    // The legacy command has no NONE stage.
+    vkCmdPipelineBarrier(command_buffer,
+                         src_stages ? src_stages : VkPipelineStageFlags{VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT},
+                         dst_stages ? dst_stages : VkPipelineStageFlags{VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT},
+                         0,
+                         0, nullptr,
+                         static_cast<uint32_t>(buffers.size()), buffers.data(),
+                         static_cast<uint32_t>(images.size()), images.data());
+}
+
+// Collects the barriers a pass needs while the pass is set up and records
+// them as one barrier command. For every buffer and every image subresource
+// (mip level and array layer) the layout, the last write, the scopes that
+// write has been made visible to and the reads since are tracked across
+// passes. A barrier therefore waits on exactly the accesses it has to
+// instead of ALL_COMMANDS, and a read needs no barrier when an earlier one
+// already made the last write visible to its stage and access. Declaring a
+// subresource twice in one pass merges both uses into one barrier, and
+// adjacent subresources with the same transition share one barrier.
+class BarrierBatch {
+public:
+    constexpr static auto WRITE_ACCESS = VkAccessFlags2KHR{
+            VK_ACCESS_2_SHADER_WRITE_BIT_KHR | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT_KHR
+            | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT_KHR | VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR
+            | VK_ACCESS_2_HOST_WRITE_BIT_KHR | VK_ACCESS_2_MEMORY_WRITE_BIT_KHR
+            | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR};
+
+    void track_image(VkImage image,
+                     VkImageAspectFlags aspect,
+                     uint32_t mip_levels,
+                     uint32_t array_layers,
+                     VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED) {
+        auto& state = images[image];
+        state.aspect = aspect;
+        state.mip_levels = mip_levels;
+        state.array_layers = array_layers;
+        state.subresources.assign(size_t{mip_levels} * array_layers, Subresource{});
+
+        for (auto& subresource: state.subresources) {
+            subresource.sync.layout = layout;
+        }
+    }
+
+    // Drops a destroyed resource, including any use declared for it since
+    // the last take().
+    void forget_image(VkImage image) {
+        images.erase(image);
+        pending_images.erase(std::remove(pending_images.begin(), pending_images.end(), image),
+                             pending_images.end());
+    }
+
+    void forget_buffer(VkBuffer buffer) {
+        buffers.erase(buffer);
+        pending_buffers.erase(std::remove(pending_buffers.begin(), pending_buffers.end(), buffer),
+                              pending_buffers.end());
+    }
+
+    void use_image(VkImage image, const VkImageSubresourceRange& range, const ResourceAccess& use) {
+        auto& state = image_state(image);
+
+        // Aspects share one tracked state per subresource, so a barrier
+        // always covers all of them.
+        if (range.aspectMask != state.aspect) {
+            throw std::invalid_argument("Image barrier aspect does not match the tracked image");
+        }
+
+        auto mip_end = range.levelCount == VK_REMAINING_MIP_LEVELS
+                       ? state.mip_levels
+                       : range.baseMipLevel + range.levelCount;
+        auto layer_end = range.layerCount == VK_REMAINING_ARRAY_LAYERS
+                         ? state.array_layers
+                         : range.baseArrayLayer + range.layerCount;
+
+        if (mip_end > state.mip_levels or layer_end > state.array_layers) {
+            throw std::out_of_range("Image barrier range exceeds the tracked image");
+        }
+
+        for (auto mip = range.baseMipLevel; mip < mip_end; ++mip) {
+            for (auto layer = range.baseArrayLayer; layer < layer_end; ++layer) {
+                declare(state.subresources[size_t{mip} * state.array_layers + layer], use);
+            }
+        }
+
+        if (not state.pending) {
+            state.pending = true;
+            pending_images.push_back(image);
+        }
+    }
+
+    void use_image(VkImage image, const ResourceAccess& use) {
+        auto whole = VkImageSubresourceRange{image_state(image).aspect, 0, VK_REMAINING_MIP_LEVELS, 0,
+                                             VK_REMAINING_ARRAY_LAYERS};
+        use_image(image, whole, use);
+    }
+
+    void use_buffer(VkBuffer buffer, const ResourceAccess& use) {
+        auto& state = buffers[buffer];
+        if (not state.touched) {
+            pending_buffers.push_back(buffer);
+        }
+        declare(state, use);
+    }
+
+    auto image_layout(VkImage image, uint32_t mip, uint32_t layer) const -> VkImageLayout {
+        auto found = images.find(image);
+        if (found == images.end() or mip >= found->second.mip_levels or layer >= found->second.array_layers) {
+            throw std::out_of_range("Image subresource is not tracked");
+        }
+        return found->second.subresources[size_t{mip} * found->second.array_layers + layer].sync.layout;
+    }
+
+    // Turns everything declared since the last call into barriers and makes
+    // the declared uses the tracked state.
+    auto take() -> PipelineBarriers {
+        auto barriers = PipelineBarriers{};
+
+        for (auto image: pending_images) {
+            auto& state = image_state(image);
+            state.pending = false;
+            append_image_barriers(image, state, barriers.images);
+        }
+
+        for (auto buffer: pending_buffers) {
+            if (auto t = transition(buffers[buffer])) {
+                barriers.buffers.push_back(VkBufferMemoryBarrier2KHR{
+                    .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2_KHR,
+                    .srcStageMask = t->src.stages,
+                    .srcAccessMask = t->src.access,
+                    .dstStageMask = t->dst.stages,
+                    .dstAccessMask = t->dst.access,
+                    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                    .buffer = buffer,
+                    .offset = 0,
+                    .size = VK_WHOLE_SIZE,
+                });
+            }
+        }
+
+        pending_images.clear();
+        pending_buffers.clear();
+        return barriers;
+    }
+
+    void flush(VkCommandBuffer command_buffer, PFN_vkCmdPipelineBarrier2KHR pipeline_barrier2 = nullptr) {
+        record_pipeline_barriers(command_buffer, take(), pipeline_barrier2);
+    }
+
+private:
+    struct SyncState {
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags2KHR write_stages = VK_PIPELINE_STAGE_2_NONE_KHR;
+        VkAccessFlags2KHR write_access = VK_ACCESS_2_NONE_KHR;
+        VkPipelineStageFlags2KHR read_stages = VK_PIPELINE_STAGE_2_NONE_KHR;
+        // Destination scopes of the barriers since the last write.
+        std::vector<ResourceAccess> visible;
+    };
+
+    struct Subresource {
+        SyncState sync;
+        ResourceAccess declared;
+        bool touched = false;
+    };
+
+    struct ImageState {
+        VkImageAspectFlags aspect = 0;
+        uint32_t mip_levels = 0;
+        uint32_t array_layers = 0;
+        std::vector<Subresource> subresources;
+        bool pending = false;
+    };
+
+    struct Transition {
+        ResourceAccess src;
+        ResourceAccess dst;
+
+        friend auto operator==(const Transition& a, const Transition& b) {
+            return a.src == b.src and a.dst == b.dst;
+        }
+    };
+
+    // A run of subresources, mips by layers, that share one transition.
+    struct Region {
+        Transition transition;
+        uint32_t base_mip;
+        uint32_t mip_count;
+        uint32_t base_layer;
+        uint32_t layer_count;
+    };
+
+    auto image_state(VkImage image) -> ImageState& {
+        auto found = images.find(image);
+        if (found == images.end()) {
+            throw std::out_of_range("Image used in a barrier batch without track_image()");
+        }
+        return found->second;
+    }
+
+    static void declare(Subresource& subresource, const ResourceAccess& use) {
+        if (not subresource.touched) {
+            subresource.declared = use;
+            subresource.touched = true;
+            return;
+        }
+
+        if (subresource.declared.layout != use.layout) {
+            throw std::runtime_error("Image subresource used in two layouts in one pass");
+        }
+        subresource.declared.stages |= use.stages;
+        subresource.declared.access |= use.access;
+    }
+
+    // Stages and accesses only pair up within one barrier, so a use has to
+    // be covered by a single earlier destination scope.
+    static auto visible_to(const SyncState& sync, VkPipelineStageFlags2KHR stages, VkAccessFlags2KHR access) {
+        return std::any_of(sync.visible.begin(), sync.visible.end(), [&](const ResourceAccess& scope) {
+            return (stages & ~scope.stages) == 0 and (access & ~scope.access) == 0;
+        });
+    }
+
+    // What a write or a layout transition has to wait for. Once a barrier
+    // has ordered the reads after the last write, waiting on those reads
+    // chains to the write as well, and its memory is already available.
+    static auto write_wait_scope(const SyncState& sync) {
+        if (not sync.visible.empty()) {
+            return ResourceAccess{sync.read_stages, VK_ACCESS_2_NONE_KHR, sync.layout};
+        }
+        return ResourceAccess{sync.write_stages | sync.read_stages, sync.write_access, sync.layout};
+    }
+
+    // Makes the declared use the tracked one and returns the barrier it
+    // needs, if any.
+    static auto transition(Subresource& subresource) -> std::optional<Transition> {
+        if (not subresource.touched) {
+            return std::nullopt;
+        }
+        subresource.touched = false;
+
+        auto& sync = subresource.sync;
+        const auto& next = subresource.declared;
+        auto writes = next.access & WRITE_ACCESS;
+        auto reads = next.access & ~WRITE_ACCESS;
+
+        auto result = std::optional<Transition>{};
+
+        if (sync.layout != next.layout or writes) {
+            auto wait = write_wait_scope(sync);
+            if (sync.layout != next.layout or wait.stages != VK_PIPELINE_STAGE_2_NONE_KHR) {
+                result = Transition{wait, next};
+            }
+
+            if (writes) {
+                sync.write_stages = next.stages;
+                sync.write_access = writes;
+                sync.read_stages = VK_PIPELINE_STAGE_2_NONE_KHR;
+                sync.visible.clear();
+            } else {
+                // A read-only layout transition: later readers wait on the
+                // transition through its destination stages, and on the
+                // write before it.
+                sync.write_stages |= next.stages;
+                sync.read_stages = next.stages;
+                sync.visible.assign(1, ResourceAccess{next.stages, reads, next.layout});
+            }
+            sync.layout = next.layout;
+            return result;
+        }
+
+        // A read in the same layout needs a barrier unless nothing was
+        // written yet or an earlier barrier made the write visible to it.
+        if (sync.write_stages != VK_PIPELINE_STAGE_2_NONE_KHR and not visible_to(sync, next.stages, reads)) {
+            result = Transition{ResourceAccess{sync.write_stages, sync.write_access, sync.layout}, next};
+            sync.visible.push_back(ResourceAccess{next.stages, reads, next.layout});
+        }
+        sync.read_stages |= next.stages;
+        return result;
+    }
+
+    static void append_image_barriers(VkImage image, ImageState& state, std::vector<VkImageMemoryBarrier2KHR>& out) {
+        auto regions = std::vector<Region>{};
+        auto row = std::vector<std::optional<Transition>>(state.array_layers);
+
+        for (auto mip = uint32_t{0}; mip < state.mip_levels; ++mip) {
+            for (auto layer = uint32_t{0}; layer < state.array_layers; ++layer) {
+                row[layer] = transition(state.subresources[size_t{mip} * state.array_layers + layer]);
+            }
+
+            for (auto begin = uint32_t{0}; begin < state.array_layers;) {
+                auto end = begin + 1;
+                if (not row[begin]) {
+                    begin = end;
+                    continue;
+                }
+                while (end < state.array_layers and row[end] and *row[end] == *row[begin]) {
+                    ++end;
+                }
+
+                // Extend the same layers' region from the previous mip level.
+                auto merged = false;
+                for (auto& region: regions) {
+                    if (region.base_mip + region.mip_count == mip and region.base_layer == begin
+                        and region.layer_count == end - begin and region.transition == *row[begin]) {
+                        ++region.mip_count;
+                        merged = true;
+                        break;
+                    }
+                }
+                if (not merged) {
+                    regions.push_back(Region{*row[begin], mip, 1, begin, end - begin});
+                }
+
+                begin = end;
+            }
+        }
+
+        for (const auto& region: regions) {
+            out.push_back(VkImageMemoryBarrier2KHR{
+                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2_KHR,
+                .srcStageMask = region.transition.src.stages,
+                .srcAccessMask = region.transition.src.access,
+                .dstStageMask = region.transition.dst.stages,
+                .dstAccessMask = region.transition.dst.access,
+                .oldLayout = region.transition.src.layout,
+                .newLayout = region.transition.dst.layout,
+                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .image = image,
+                .subresourceRange = {state.aspect, region.base_mip, region.mip_count,
+                                     region.base_layer, region.layer_count},
+            });
+        }
+    }
+
+    std::map<VkImage, ImageState> images;
+    std::map<VkBuffer, Subresource> buffers;
+    std::vector<VkImage> pending_images;
+    std::vector<VkBuffer> pending_buffers;
+};
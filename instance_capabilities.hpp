@@ -0,0 +1,296 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+// What the Vulkan loader offers before an instance exists. Probing it means
+// enumerating every layer and extension, which loads and parses every
+// manifest on the system, so the result is cached on disk and reused until
+// something that could change it does.
+struct InstanceCapabilities {
+    uint32_t loader_version = VK_API_VERSION_1_0;
+    std::vector<std::string> layers;
+    std::vector<std::string> extensions;
+    bool from_cache = false;
+
+    auto has_layer(const char* name) const {
+        return std::find(layers.begin(), layers.end(), name) != layers.end();
+    }
+
+    auto has_extension(const char* name) const {
+        return std::find(extensions.begin(), extensions.end(), name) != extensions.end();
+    }
+};
+
+// vkEnumerateInstanceVersion only exists from loader 1.1 onwards.
+inline auto query_loader_version() {
+    auto enumerate_version = reinterpret_cast<PFN_vkEnumerateInstanceVersion>(
+            vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion"));
+
+    auto version = uint32_t{VK_API_VERSION_1_0};
+    if (enumerate_version and enumerate_version(&version) != VK_SUCCESS) {
+        version = VK_API_VERSION_1_0;
+    }
+    return version;
+}
+
+inline auto probe_instance_capabilities() {
+    auto capabilities = InstanceCapabilities{};
+    capabilities.loader_version = query_loader_version();
+
+    auto layer_count = uint32_t{0};
+    vkEnumerateInstanceLayerProperties(&layer_count, nullptr);
+    auto layers = std::vector<VkLayerProperties>(layer_count);
+    vkEnumerateInstanceLayerProperties(&layer_count, layers.data());
+
+    for (auto i = uint32_t{0}; i < layer_count; ++i) {
+        capabilities.layers.emplace_back(layers[i].layerName);
+    }
+
+    auto extension_count = uint32_t{0};
+    vkEnumerateInstanceExtensionProperties(nullptr, &extension_count, nullptr);
+    auto extensions = std::vector<VkExtensionProperties>(extension_count);
+    vkEnumerateInstanceExtensionProperties(nullptr, &extension_count, extensions.data());
+
+    for (auto i = uint32_t{0}; i < extension_count; ++i) {
+        capabilities.extensions.emplace_back(extensions[i].extensionName);
+    }
+
+    return capabilities;
+}
+
+// Instance capability cache
+// The key covers everything that decides what the loader reports: its own
+// version, the headers we were built against, the environment variables it
+// reads manifests and layers from (including the XDG search paths), and the
+// modification times of the manifest directories (installing or removing a
+// driver or layer touches them). All of these are cheap to read compared to
+// a full enumeration.
+inline auto instance_capabilities_cache_key(uint32_t loader_version) {
+    auto identity = std::ostringstream{};
+    identity << loader_version << ';' << VK_HEADER_VERSION_COMPLETE << ';';
+
+    for (auto variable: {"VK_ICD_FILENAMES", "VK_DRIVER_FILES", "VK_ADD_DRIVER_FILES",
+                         "VK_LAYER_PATH", "VK_ADD_LAYER_PATH", "VK_INSTANCE_LAYERS",
+                         "VK_LOADER_LAYERS_ENABLE", "VK_LOADER_LAYERS_DISABLE",
+                         "XDG_CONFIG_HOME", "XDG_CONFIG_DIRS", "XDG_DATA_HOME", "XDG_DATA_DIRS"}) {
+        auto value = std::getenv(variable);
+        identity << variable << '=' << (value ? value : "") << ';';
+    }
+
+    // The directories the loader searches for manifests, in the order it
+    // does: XDG config, system config, then XDG data.
+    auto environment = [](const char* variable, std::string fallback) {
+        auto value = std::getenv(variable);
+        return value and *value ? std::string{value} : fallback;
+    };
+
+    auto home = environment("HOME", "");
+    auto roots = std::vector<std::string>{};
+
+    auto add_roots = [&](const std::string& directories) {
+        auto stream = std::istringstream{directories};
+        auto directory = std::string{};
+        while (std::getline(stream, directory, ':')) {
+            if (not directory.empty()) {
+                roots.push_back(directory + "/vulkan");
+            }
+        }
+    };
+
+    add_roots(environment("XDG_CONFIG_HOME", home.empty() ? "" : home + "/.config"));
+    add_roots(environment("XDG_CONFIG_DIRS", "/etc/xdg"));
+    add_roots("/etc:/usr/local/etc");
+    add_roots(environment("XDG_DATA_HOME", home.empty() ? "" : home + "/.local/share"));
+    add_roots(environment("XDG_DATA_DIRS", "/usr/local/share:/usr/share"));
+
+    for (const auto& root: roots) {
+        for (auto directory: {"/icd.d", "/implicit_layer.d", "/explicit_layer.d"}) {
+            auto path = root + directory;
+            struct stat info{};
+            if (stat(path.c_str(), &info) == 0) {
+                identity << path << '@' << info.st_mtime << ';';
+            }
+        }
+    }
+
+    // FNV-1a
+    auto hash = uint64_t{14695981039346656037ull};
+    for (auto c: identity.str()) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+    }
+
+    auto key = std::ostringstream{};
+    key << std::hex << std::setw(16) << std::setfill('0') << hash;
+    return key.str();
+}
+
+inline auto instance_capabilities_cache_path() -> std::string {
+    if (auto cache_home = std::getenv("XDG_CACHE_HOME"); cache_home and *cache_home) {
+        return std::string{cache_home} + "/vulkan-tutorial-instance-capabilities";
+    }
+
+    if (auto home = std::getenv("HOME"); home and *home) {
+        return std::string{home} + "/.cache/vulkan-tutorial-instance-capabilities";
+    }
+
+    return {};
+}
+
+// File format, one entry per line:
+//     key <hex>
+//     loader <version>
+//     layer <name>
+//     extension <name>
+inline void save_instance_capabilities(const InstanceCapabilities& capabilities, const std::string& key) {
+    auto path = instance_capabilities_cache_path();
+    if (path.empty()) {
+        return;
+    }
+
+    // Write then rename so a concurrent launch never reads half a file.
+    auto temporary = path + ".tmp";
+    {
+        auto file = std::ofstream{temporary, std::ios::trunc};
+        if (not file) {
+            return;
+        }
+
+        file << "key " << key << '\n'
+             << "loader " << capabilities.loader_version << '\n';
+        for (const auto& layer: capabilities.layers) {
+            file << "layer " << layer << '\n';
+        }
+        for (const auto& extension: capabilities.extensions) {
+            file << "extension " << extension << '\n';
+        }
+    }
+
+    std::rename(temporary.c_str(), path.c_str());
+}
+
+inline auto load_instance_capabilities(const std::string& key, InstanceCapabilities& capabilities) {
+    auto file = std::ifstream{instance_capabilities_cache_path()};
+    if (not file) {
+        return false;
+    }
+
+    auto line = std::string{};
+    if (not std::getline(file, line) or line != "key " + key) {
+        return false;
+    }
+
+    auto cached = InstanceCapabilities{};
+    cached.from_cache = true;
+
+    while (std::getline(file, line)) {
+        auto space = line.find(' ');
+        if (space == std::string::npos) {
+            return false;
+        }
+
+        auto kind = line.substr(0, space);
+        auto value = line.substr(space + 1);
+
+        if (kind == "loader") {
+            cached.loader_version = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+        } else if (kind == "layer") {
+            cached.layers.push_back(std::move(value));
+        } else if (kind == "extension") {
+            cached.extensions.push_back(std::move(value));
+        } else {
+            return false;
+        }
+    }
+
+    capabilities = std::move(cached);
+    return true;
+}
+
+inline auto get_instance_capabilities(bool use_cache = true) {
+    auto loader_version = query_loader_version();
+    auto key = instance_capabilities_cache_key(loader_version);
+
+    auto capabilities = InstanceCapabilities{};
+    if (use_cache and load_instance_capabilities(key, capabilities)) {
+        return capabilities;
+    }
+
+    capabilities = probe_instance_capabilities();
+    save_instance_capabilities(capabilities, key);
+    return capabilities;
+}
+
+// Instance capability negotiation
+struct InstanceRequest {
+    std::vector<const char*> required_layers;
+    std::vector<const char*> optional_layers;
+    std::vector<const char*> required_extensions;
+    std::vector<const char*> optional_extensions;
+};
+
+// What create_instance() actually enabled, so later code can rely on an
+// optional layer or extension or cleanly skip what depends on it.
+struct EnabledInstanceSet {
+    std::vector<const char*> layers;
+    std::vector<const char*> extensions;
+    std::vector<const char*> missing_required;
+    std::vector<const char*> missing_optional;
+
+    auto has_layer(const char* name) const {
+        return contains(layers, name);
+    }
+
+    auto has_extension(const char* name) const {
+        return contains(extensions, name);
+    }
+
+    static auto contains(const std::vector<const char*>& names, const char* name) -> bool {
+        return std::any_of(names.begin(), names.end(), [&](const char* n) {
+            return std::strcmp(n, name) == 0;
+        });
+    }
+};
+
+inline auto negotiate_instance_set(const InstanceCapabilities& capabilities, const InstanceRequest& request) {
+    auto enabled = EnabledInstanceSet{};
+
+    auto merge = [&](const std::vector<const char*>& names,
+                     bool available(const InstanceCapabilities&, const char*),
+                     std::vector<const char*>& into,
+                     std::vector<const char*>& missing) {
+        for (auto name: names) {
+            if (EnabledInstanceSet::contains(into, name) or EnabledInstanceSet::contains(missing, name)) {
+                continue;
+            }
+
+            if (available(capabilities, name)) {
+                into.push_back(name);
+            } else {
+                missing.push_back(name);
+            }
+        }
+    };
+
+    auto has_layer = [](const InstanceCapabilities& c, const char* name) { return c.has_layer(name); };
+    auto has_extension = [](const InstanceCapabilities& c, const char* name) { return c.has_extension(name); };
+
+    merge(request.required_layers, has_layer, enabled.layers, enabled.missing_required);
+    merge(request.optional_layers, has_layer, enabled.layers, enabled.missing_optional);
+    merge(request.required_extensions, has_extension, enabled.extensions, enabled.missing_required);
+    merge(request.optional_extensions, has_extension, enabled.extensions, enabled.missing_optional);
+
+    return enabled;
+}
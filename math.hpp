@@ -0,0 +1,298 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define MATH_USE_SSE 1
+#if defined(__AVX__)
+#include <immintrin.h>
+#define MATH_USE_AVX 1
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define MATH_USE_NEON 1
+#endif
+
+// Small vector math library. Everything can be built in a constant
+// expression; the hot operations (4-wide arithmetic, matrix products, batch
+// kernels) go through SSE or NEON when the target has them and fall back to
+// plain loops otherwise. Matrices are column-major, matching GLSL.
+namespace math {
+
+struct Vec3 {
+    float x, y, z;
+
+    constexpr Vec3(): x{0}, y{0}, z{0} {}
+    constexpr Vec3(float x, float y, float z): x{x}, y{y}, z{z} {}
+    constexpr explicit Vec3(float s): x{s}, y{s}, z{s} {}
+};
+
+constexpr auto operator+(Vec3 a, Vec3 b) { return Vec3{a.x + b.x, a.y + b.y, a.z + b.z}; }
+constexpr auto operator-(Vec3 a, Vec3 b) { return Vec3{a.x - b.x, a.y - b.y, a.z - b.z}; }
+constexpr auto operator*(Vec3 a, float s) { return Vec3{a.x * s, a.y * s, a.z * s}; }
+constexpr auto operator*(float s, Vec3 a) { return a * s; }
+constexpr auto dot(Vec3 a, Vec3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+constexpr auto cross(Vec3 a, Vec3 b) {
+    return Vec3{a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+inline auto length(Vec3 a) { return std::sqrt(dot(a, a)); }
+inline auto normalize(Vec3 a) { return a * (1.0f / length(a)); }
+
+struct alignas(16) Vec4 {
+    float x, y, z, w;
+
+    constexpr Vec4(): x{0}, y{0}, z{0}, w{0} {}
+    constexpr Vec4(float x, float y, float z, float w): x{x}, y{y}, z{z}, w{w} {}
+    constexpr Vec4(Vec3 v, float w): x{v.x}, y{v.y}, z{v.z}, w{w} {}
+
+    constexpr auto xyz() const { return Vec3{x, y, z}; }
+};
+
+#if defined(MATH_USE_SSE)
+inline auto load(const Vec4& v) { return _mm_load_ps(&v.x); }
+inline auto store(__m128 r) { auto v = Vec4{}; _mm_store_ps(&v.x, r); return v; }
+inline auto operator+(const Vec4& a, const Vec4& b) { return store(_mm_add_ps(load(a), load(b))); }
+inline auto operator-(const Vec4& a, const Vec4& b) { return store(_mm_sub_ps(load(a), load(b))); }
+inline auto operator*(const Vec4& a, float s) { return store(_mm_mul_ps(load(a), _mm_set1_ps(s))); }
+#elif defined(MATH_USE_NEON)
+inline auto load(const Vec4& v) { return vld1q_f32(&v.x); }
+inline auto store(float32x4_t r) { auto v = Vec4{}; vst1q_f32(&v.x, r); return v; }
+inline auto operator+(const Vec4& a, const Vec4& b) { return store(vaddq_f32(load(a), load(b))); }
+inline auto operator-(const Vec4& a, const Vec4& b) { return store(vsubq_f32(load(a), load(b))); }
+inline auto operator*(const Vec4& a, float s) { return store(vmulq_n_f32(load(a), s)); }
+#else
+inline auto operator+(const Vec4& a, const Vec4& b) { return Vec4{a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w}; }
+inline auto operator-(const Vec4& a, const Vec4& b) { return Vec4{a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w}; }
+inline auto operator*(const Vec4& a, float s) { return Vec4{a.x * s, a.y * s, a.z * s, a.w * s}; }
+#endif
+
+constexpr auto dot(const Vec4& a, const Vec4& b) { return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w; }
+
+struct Quat {
+    float x, y, z, w;
+
+    constexpr Quat(): x{0}, y{0}, z{0}, w{1} {}
+    constexpr Quat(float x, float y, float z, float w): x{x}, y{y}, z{z}, w{w} {}
+
+    static auto from_axis_angle(Vec3 axis, float radians) {
+        auto s = std::sin(radians * 0.5f);
+        auto a = normalize(axis);
+        return Quat{a.x * s, a.y * s, a.z * s, std::cos(radians * 0.5f)};
+    }
+};
+
+constexpr auto operator*(Quat a, Quat b) {
+    return Quat{
+        a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+        a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+        a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+        a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
+    };
+}
+
+constexpr auto rotate(Quat q, Vec3 v) {
+    auto u = Vec3{q.x, q.y, q.z};
+    auto t = cross(u, v) * 2.0f;
+    return v + t * q.w + cross(u, t);
+}
+
+struct alignas(16) Mat4 {
+    Vec4 columns[4];
+
+    constexpr Mat4(): columns{{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}, {0, 0, 0, 1}} {}
+    constexpr Mat4(Vec4 c0, Vec4 c1, Vec4 c2, Vec4 c3): columns{c0, c1, c2, c3} {}
+
+    static constexpr auto translation(Vec3 t) {
+        return Mat4{{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}, {t, 1}};
+    }
+
+    static constexpr auto scale(Vec3 s) {
+        return Mat4{{s.x, 0, 0, 0}, {0, s.y, 0, 0}, {0, 0, s.z, 0}, {0, 0, 0, 1}};
+    }
+
+    // translation * rotation * scale, built directly instead of multiplied.
+    static constexpr auto from_trs(Vec3 t, Quat q, Vec3 s) {
+        auto xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+        auto xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+        auto wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+        return Mat4{
+            {(1 - 2 * (yy + zz)) * s.x, 2 * (xy + wz) * s.x, 2 * (xz - wy) * s.x, 0},
+            {2 * (xy - wz) * s.y, (1 - 2 * (xx + zz)) * s.y, 2 * (yz + wx) * s.y, 0},
+            {2 * (xz + wy) * s.z, 2 * (yz - wx) * s.z, (1 - 2 * (xx + yy)) * s.z, 0},
+            {t, 1},
+        };
+    }
+
+    auto data() const { return &columns[0].x; }
+};
+
+// Reference implementation, also what non-SIMD targets use.
+inline void multiply_scalar(const Mat4& a, const Mat4& b, Mat4& out) {
+    const auto* lhs = a.data();
+    const auto* rhs = b.data();
+    auto* result = &out.columns[0].x;
+
+    for (auto j = 0; j < 4; ++j) {
+        for (auto i = 0; i < 4; ++i) {
+            auto sum = 0.0f;
+            for (auto k = 0; k < 4; ++k) {
+                sum += lhs[4 * k + i] * rhs[4 * j + k];
+            }
+            result[4 * j + i] = sum;
+        }
+    }
+}
+
+// Column j of a * b is a's columns weighted by the entries of b's column j.
+inline void multiply(const Mat4& a, const Mat4& b, Mat4& out) {
+#if defined(MATH_USE_SSE)
+    auto a0 = load(a.columns[0]), a1 = load(a.columns[1]), a2 = load(a.columns[2]), a3 = load(a.columns[3]);
+
+    for (auto j = 0; j < 4; ++j) {
+        const auto& c = b.columns[j];
+        auto r = _mm_mul_ps(a0, _mm_set1_ps(c.x));
+        r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(c.y)));
+        r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(c.z)));
+        r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(c.w)));
+        _mm_store_ps(&out.columns[j].x, r);
+    }
+#elif defined(MATH_USE_NEON)
+    auto a0 = load(a.columns[0]), a1 = load(a.columns[1]), a2 = load(a.columns[2]), a3 = load(a.columns[3]);
+
+    for (auto j = 0; j < 4; ++j) {
+        const auto& c = b.columns[j];
+        auto r = vmulq_n_f32(a0, c.x);
+        r = vmlaq_n_f32(r, a1, c.y);
+        r = vmlaq_n_f32(r, a2, c.z);
+        r = vmlaq_n_f32(r, a3, c.w);
+        vst1q_f32(&out.columns[j].x, r);
+    }
+#else
+    multiply_scalar(a, b, out);
+#endif
+}
+
+inline auto operator*(const Mat4& a, const Mat4& b) {
+    auto out = Mat4{};
+    multiply(a, b, out);
+    return out;
+}
+
+constexpr auto transform_point(const Mat4& m, Vec3 p) {
+    const auto& c = m.columns;
+    return Vec3{
+        c[0].x * p.x + c[1].x * p.y + c[2].x * p.z + c[3].x,
+        c[0].y * p.x + c[1].y * p.y + c[2].y * p.z + c[3].y,
+        c[0].z * p.x + c[1].z * p.y + c[2].z * p.z + c[3].z,
+    };
+}
+
+// Eight Vec3s in structure-of-arrays form, so one SIMD register holds the
+// same component of eight vectors (AVX: one register, SSE/NEON: two).
+struct alignas(32) Vec3x8 {
+    constexpr static auto WIDTH = size_t{8};
+
+    float x[WIDTH];
+    float y[WIDTH];
+    float z[WIDTH];
+
+    constexpr auto get(size_t i) const { return Vec3{x[i], y[i], z[i]}; }
+    constexpr void set(size_t i, Vec3 v) { x[i] = v.x; y[i] = v.y; z[i] = v.z; }
+};
+
+// Reference implementation, also what non-SIMD targets use.
+inline void dot_plus_scalar(const Vec3x8& v, Vec3 n, float d, float* out) {
+    for (auto i = size_t{0}; i < Vec3x8::WIDTH; ++i) {
+        out[i] = v.x[i] * n.x + v.y[i] * n.y + v.z[i] * n.z + d;
+    }
+}
+
+// out[i] = dot(v[i], n) + d, e.g. the signed distance of eight points to a
+// plane.
+inline void dot_plus(const Vec3x8& v, Vec3 n, float d, float* out) {
+#if defined(MATH_USE_AVX)
+    auto r = _mm256_set1_ps(d);
+    r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_load_ps(v.x), _mm256_set1_ps(n.x)));
+    r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_load_ps(v.y), _mm256_set1_ps(n.y)));
+    r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_load_ps(v.z), _mm256_set1_ps(n.z)));
+    _mm256_storeu_ps(out, r);
+#elif defined(MATH_USE_SSE)
+    for (auto i = size_t{0}; i < Vec3x8::WIDTH; i += 4) {
+        auto r = _mm_set1_ps(d);
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_load_ps(v.x + i), _mm_set1_ps(n.x)));
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_load_ps(v.y + i), _mm_set1_ps(n.y)));
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_load_ps(v.z + i), _mm_set1_ps(n.z)));
+        _mm_storeu_ps(out + i, r);
+    }
+#elif defined(MATH_USE_NEON)
+    for (auto i = size_t{0}; i < Vec3x8::WIDTH; i += 4) {
+        auto r = vdupq_n_f32(d);
+        r = vmlaq_n_f32(r, vld1q_f32(v.x + i), n.x);
+        r = vmlaq_n_f32(r, vld1q_f32(v.y + i), n.y);
+        r = vmlaq_n_f32(r, vld1q_f32(v.z + i), n.z);
+        vst1q_f32(out + i, r);
+    }
+#else
+    dot_plus_scalar(v, n, d, out);
+#endif
+}
+
+// Transforms eight points by the same matrix.
+inline auto transform_points(const Mat4& m, const Vec3x8& p) {
+    // Every lane is written below; zero-initializing out first costs more
+    // than the transform itself.
+    Vec3x8 out;
+
+#if defined(MATH_USE_SSE)
+    // Broadcast the 12 matrix entries once for both halves. Named values
+    // rather than an array indexed at run time, so they stay in registers.
+    const auto& c = m.columns;
+    auto m00 = _mm_set1_ps(c[0].x), m01 = _mm_set1_ps(c[1].x), m02 = _mm_set1_ps(c[2].x), m03 = _mm_set1_ps(c[3].x);
+    auto m10 = _mm_set1_ps(c[0].y), m11 = _mm_set1_ps(c[1].y), m12 = _mm_set1_ps(c[2].y), m13 = _mm_set1_ps(c[3].y);
+    auto m20 = _mm_set1_ps(c[0].z), m21 = _mm_set1_ps(c[1].z), m22 = _mm_set1_ps(c[2].z), m23 = _mm_set1_ps(c[3].z);
+
+    for (auto i = size_t{0}; i < Vec3x8::WIDTH; i += 4) {
+        auto px = _mm_load_ps(p.x + i), py = _mm_load_ps(p.y + i), pz = _mm_load_ps(p.z + i);
+
+        auto x = _mm_add_ps(m03, _mm_mul_ps(px, m00));
+        x = _mm_add_ps(x, _mm_mul_ps(py, m01));
+        x = _mm_add_ps(x, _mm_mul_ps(pz, m02));
+        _mm_store_ps(out.x + i, x);
+
+        auto y = _mm_add_ps(m13, _mm_mul_ps(px, m10));
+        y = _mm_add_ps(y, _mm_mul_ps(py, m11));
+        y = _mm_add_ps(y, _mm_mul_ps(pz, m12));
+        _mm_store_ps(out.y + i, y);
+
+        auto z = _mm_add_ps(m23, _mm_mul_ps(px, m20));
+        z = _mm_add_ps(z, _mm_mul_ps(py, m21));
+        z = _mm_add_ps(z, _mm_mul_ps(pz, m22));
+        _mm_store_ps(out.z + i, z);
+    }
+#elif defined(MATH_USE_NEON)
+    const auto& c = m.columns;
+    for (auto i = size_t{0}; i < Vec3x8::WIDTH; i += 4) {
+        auto px = vld1q_f32(p.x + i), py = vld1q_f32(p.y + i), pz = vld1q_f32(p.z + i);
+        auto row = [&](float m0, float m1, float m2, float m3) {
+            auto r = vdupq_n_f32(m3);
+            r = vmlaq_n_f32(r, px, m0);
+            r = vmlaq_n_f32(r, py, m1);
+            return vmlaq_n_f32(r, pz, m2);
+        };
+        vst1q_f32(out.x + i, row(c[0].x, c[1].x, c[2].x, c[3].x));
+        vst1q_f32(out.y + i, row(c[0].y, c[1].y, c[2].y, c[3].y));
+        vst1q_f32(out.z + i, row(c[0].z, c[1].z, c[2].z, c[3].z));
+    }
+#else
+    for (auto i = size_t{0}; i < Vec3x8::WIDTH; ++i) {
+        out.set(i, transform_point(m, p.get(i)));
+    }
+#endif
+
+    return out;
+}
+
+}
@@ -0,0 +1,391 @@
+#pragma once
+
+#include "math.hpp"
+#include "scene.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <queue>
+#include <utility>
+#include <vector>
+
+// Level-of-detail chains built offline by edge-collapse simplification with
+// quadric error metrics (Garland and Heckbert), and picked at run time by
+// the error they would show on screen.
+namespace mesh {
+
+// One level of detail: a range of LodMesh::indices and how far, in mesh
+// units, its surface may be from the full-detail one.
+struct Lod {
+    uint32_t first_index;
+    uint32_t index_count;
+    float error;
+};
+
+// Every level indexes the same vertices, so a mesh keeps one vertex buffer
+// and one index buffer whatever level is drawn. Levels go from full detail
+// to coarsest; their errors never decrease.
+struct LodMesh {
+    std::vector<math::Vec3> positions;
+    std::vector<uint32_t> indices;
+    std::vector<Lod> lods;
+};
+
+// Sum of squared distances to a set of planes, as the symmetric 4x4 matrix
+// of the quadric form.
+struct Quadric {
+    double a2 = 0, ab = 0, ac = 0, ad = 0;
+    double b2 = 0, bc = 0, bd = 0;
+    double c2 = 0, cd = 0;
+    double d2 = 0;
+
+    // The plane n.p + d = 0, with n of unit length.
+    static auto plane(math::Vec3 n, float d, double weight = 1.0) {
+        return Quadric{
+            weight * n.x * n.x, weight * n.x * n.y, weight * n.x * n.z, weight * n.x * d,
+            weight * n.y * n.y, weight * n.y * n.z, weight * n.y * d,
+            weight * n.z * n.z, weight * n.z * d,
+            weight * d * d,
+        };
+    }
+
+    auto& operator+=(const Quadric& q) {
+        a2 += q.a2;
+        ab += q.ab;
+        ac += q.ac;
+        ad += q.ad;
+        b2 += q.b2;
+        bc += q.bc;
+        bd += q.bd;
+        c2 += q.c2;
+        cd += q.cd;
+        d2 += q.d2;
+        return *this;
+    }
+
+    auto error(math::Vec3 p) const {
+        double x = p.x, y = p.y, z = p.z;
+        auto e = a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+                 + b2 * y * y + 2 * bc * y * z + 2 * bd * y
+                 + c2 * z * z + 2 * cd * z
+                 + d2;
+        return std::max(e, 0.0);
+    }
+};
+
+// Collapses edges, cheapest first, until at most target_index_count indices
+// are left or no collapse is possible without flipping a triangle. A vertex
+// is always collapsed onto the other end of its edge, so the result indexes
+// the original positions. error, if given, receives the square root of the
+// largest quadric error of any collapse made, roughly the farthest the
+// simplified surface moved.
+inline auto simplify(const std::vector<math::Vec3>& positions,
+                     const std::vector<uint32_t>& indices,
+                     size_t target_index_count,
+                     float* error = nullptr) -> std::vector<uint32_t> {
+    auto vertex_count = positions.size();
+    auto triangles = indices;
+    auto triangle_count = triangles.size() / 3;
+    auto alive = std::vector<uint8_t>(triangle_count, 1);
+    auto live_indices = triangles.size();
+
+    auto quadrics = std::vector<Quadric>(vertex_count);
+    auto adjacency = std::vector<std::vector<uint32_t>>(vertex_count);
+    auto edge_uses = std::map<std::pair<uint32_t, uint32_t>, uint32_t>{};
+
+    auto edge_key = [](uint32_t a, uint32_t b) { return std::pair{std::min(a, b), std::max(a, b)}; };
+
+    auto normal_of = [&](uint32_t a, uint32_t b, uint32_t c) {
+        return math::cross(positions[b] - positions[a], positions[c] - positions[a]);
+    };
+
+    for (auto t = size_t{0}; t < triangle_count; ++t) {
+        auto* v = &triangles[3 * t];
+        auto n = normal_of(v[0], v[1], v[2]);
+        auto area = math::length(n);
+        if (area > 0) {
+            n = n * (1.0f / area);
+            auto plane = Quadric::plane(n, -math::dot(n, positions[v[0]]));
+            for (auto i = 0; i < 3; ++i) {
+                quadrics[v[i]] += plane;
+            }
+        }
+        for (auto i = 0; i < 3; ++i) {
+            adjacency[v[i]].push_back(static_cast<uint32_t>(t));
+            ++edge_uses[edge_key(v[i], v[(i + 1) % 3])];
+        }
+    }
+
+    // Open borders would otherwise erode freely: pin each border edge with
+    // a heavily weighted plane through it, perpendicular to its triangle.
+    constexpr auto BORDER_WEIGHT = 10.0;
+    for (auto t = size_t{0}; t < triangle_count; ++t) {
+        auto* v = &triangles[3 * t];
+        auto n = normal_of(v[0], v[1], v[2]);
+        for (auto i = 0; i < 3; ++i) {
+            auto a = v[i], b = v[(i + 1) % 3];
+            if (edge_uses[edge_key(a, b)] != 1) {
+                continue;
+            }
+            auto side = math::cross(positions[b] - positions[a], n);
+            auto length = math::length(side);
+            if (length > 0) {
+                side = side * (1.0f / length);
+                auto plane = Quadric::plane(side, -math::dot(side, positions[a]), BORDER_WEIGHT);
+                quadrics[a] += plane;
+                quadrics[b] += plane;
+            }
+        }
+    }
+
+    // Candidate collapses of from onto to. A collapse changes the quadric of
+    // the vertex it keeps, so entries carry the versions of both vertices
+    // they were computed for and stale ones are skipped; the orientation
+    // check when an entry is popped covers changed neighbourhoods.
+    struct Collapse {
+        double cost;
+        uint32_t from;
+        uint32_t to;
+        uint32_t from_version;
+        uint32_t to_version;
+
+        auto operator>(const Collapse& other) const { return cost > other.cost; }
+    };
+
+    auto versions = std::vector<uint32_t>(vertex_count, 0);
+    auto removed = std::vector<uint8_t>(vertex_count, 0);
+    auto heap = std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>>{};
+
+    auto push_edge = [&](uint32_t a, uint32_t b) {
+        auto sum = quadrics[a];
+        sum += quadrics[b];
+        auto onto_b = sum.error(positions[b]);
+        auto onto_a = sum.error(positions[a]);
+        if (onto_b <= onto_a) {
+            heap.push(Collapse{onto_b, a, b, versions[a], versions[b]});
+        } else {
+            heap.push(Collapse{onto_a, b, a, versions[b], versions[a]});
+        }
+    };
+
+    for (const auto& [edge, uses]: edge_uses) {
+        push_edge(edge.first, edge.second);
+    }
+
+    auto neighbours = [&](uint32_t vertex) {
+        auto result = std::vector<uint32_t>{};
+        for (auto t: adjacency[vertex]) {
+            if (alive[t]) {
+                for (auto i = 0; i < 3; ++i) {
+                    if (triangles[3 * t + i] != vertex) {
+                        result.push_back(triangles[3 * t + i]);
+                    }
+                }
+            }
+        }
+        std::sort(result.begin(), result.end());
+        result.erase(std::unique(result.begin(), result.end()), result.end());
+        return result;
+    };
+
+    // The ends of the edge may only share the neighbours opposite the edge
+    // (the link condition), or the collapse would fold the surface onto
+    // itself; and moving from onto to must not flip or flatten any triangle
+    // that stays.
+    auto can_collapse = [&](uint32_t from, uint32_t to) {
+        auto edge_triangles = std::count_if(adjacency[from].begin(), adjacency[from].end(), [&](uint32_t t) {
+            const auto* v = &triangles[3 * t];
+            return alive[t] and (v[0] == to or v[1] == to or v[2] == to);
+        });
+        auto from_neighbours = neighbours(from);
+        auto to_neighbours = neighbours(to);
+        auto shared = std::vector<uint32_t>{};
+        std::set_intersection(from_neighbours.begin(), from_neighbours.end(), to_neighbours.begin(),
+                              to_neighbours.end(), std::back_inserter(shared));
+        if (static_cast<ptrdiff_t>(shared.size()) > edge_triangles) {
+            return false;
+        }
+
+        for (auto t: adjacency[from]) {
+            if (not alive[t]) {
+                continue;
+            }
+            auto* v = &triangles[3 * t];
+            if (v[0] == to or v[1] == to or v[2] == to) {
+                continue;
+            }
+            auto before = normal_of(v[0], v[1], v[2]);
+            auto moved = std::array<uint32_t, 3>{v[0], v[1], v[2]};
+            for (auto& index: moved) {
+                if (index == from) {
+                    index = to;
+                }
+            }
+            auto after = normal_of(moved[0], moved[1], moved[2]);
+            if (math::dot(before, after) <= 0 or math::dot(after, after) <= 1e-12f * math::dot(before, before)) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    auto max_cost = 0.0;
+
+    while (live_indices > target_index_count and not heap.empty()) {
+        auto collapse = heap.top();
+        heap.pop();
+
+        auto from = collapse.from, to = collapse.to;
+        if (removed[from] or removed[to] or versions[from] != collapse.from_version
+            or versions[to] != collapse.to_version) {
+            continue;
+        }
+        if (not can_collapse(from, to)) {
+            continue;
+        }
+
+        for (auto t: adjacency[from]) {
+            if (not alive[t]) {
+                continue;
+            }
+            auto* v = &triangles[3 * t];
+            if (v[0] == to or v[1] == to or v[2] == to) {
+                alive[t] = 0;
+                live_indices -= 3;
+                continue;
+            }
+            for (auto i = 0; i < 3; ++i) {
+                if (v[i] == from) {
+                    v[i] = to;
+                }
+            }
+            adjacency[to].push_back(t);
+        }
+
+        removed[from] = 1;
+        quadrics[to] += quadrics[from];
+        ++versions[to];
+        max_cost = std::max(max_cost, collapse.cost);
+
+        // Re-queue the edges around the surviving vertex with its new
+        // quadric. Dead triangles are dropped from its list on the way.
+        auto& around = adjacency[to];
+        around.erase(std::remove_if(around.begin(), around.end(), [&](uint32_t t) { return not alive[t]; }),
+                     around.end());
+        std::sort(around.begin(), around.end());
+        around.erase(std::unique(around.begin(), around.end()), around.end());
+        for (auto t: around) {
+            for (auto i = 0; i < 3; ++i) {
+                auto other = triangles[3 * t + i];
+                if (other != to) {
+                    push_edge(to, other);
+                }
+            }
+        }
+    }
+
+    if (error) {
+        *error = static_cast<float>(std::sqrt(max_cost));
+    }
+
+    auto result = std::vector<uint32_t>{};
+    result.reserve(live_indices);
+    for (auto t = size_t{0}; t < triangle_count; ++t) {
+        if (alive[t]) {
+            result.insert(result.end(), &triangles[3 * t], &triangles[3 * t] + 3);
+        }
+    }
+    return result;
+}
+
+// Builds a chain of levels with about ratio times the full-detail index
+// count each, for ratios in decreasing order. Each level simplifies the
+// previous one, so its error includes everything removed before it. The
+// chain stops early once a level can no longer be reduced.
+inline auto build_lod_chain(std::vector<math::Vec3> positions,
+                            const std::vector<uint32_t>& indices,
+                            const std::vector<float>& ratios) -> LodMesh {
+    auto mesh = LodMesh{std::move(positions), indices, {}};
+    mesh.lods.push_back(Lod{0, static_cast<uint32_t>(indices.size()), 0.0f});
+
+    auto previous = indices;
+    auto error = 0.0f;
+
+    for (auto ratio: ratios) {
+        auto target = static_cast<size_t>(static_cast<double>(indices.size()) * ratio) / 3 * 3;
+        auto level_error = 0.0f;
+        auto level = simplify(mesh.positions, previous, target, &level_error);
+        if (level.size() >= previous.size()) {
+            break;
+        }
+
+        error = std::max(error, level_error);
+        mesh.lods.push_back(Lod{static_cast<uint32_t>(mesh.indices.size()), static_cast<uint32_t>(level.size()), error});
+        mesh.indices.insert(mesh.indices.end(), level.begin(), level.end());
+        previous = std::move(level);
+    }
+
+    return mesh;
+}
+
+// What LOD selection needs to know about the view. projection_scale turns
+// a size at unit distance into pixels: the viewport height divided by
+// 2 tan(vertical_fov / 2).
+struct LodView {
+    math::Vec3 camera;
+    float projection_scale;
+    float max_pixel_error;
+};
+
+inline auto projection_scale(float vertical_fov, float viewport_height) {
+    return viewport_height / (2.0f * std::tan(vertical_fov * 0.5f));
+}
+
+// Picks the coarsest level whose error, projected from the closest point
+// of the bounding sphere, stays within the allowed number of pixels. scale
+// is the largest scale factor of the object's transform.
+inline auto select_lod(const LodMesh& mesh, const scene::BoundingSphere& bounds, float scale, const LodView& view)
+        -> size_t {
+    auto distance = math::length(bounds.center - view.camera) - bounds.radius;
+    if (distance <= 0.0f) {
+        return 0;
+    }
+
+    for (auto lod = mesh.lods.size(); lod-- > 1;) {
+        if (mesh.lods[lod].error * scale * view.projection_scale <= view.max_pixel_error * distance) {
+            return lod;
+        }
+    }
+    return 0;
+}
+
+// LOD selection for the culling pass: picks a level for every object of
+// the scene, writes it to lods[i] for dense index i and returns the number
+// of triangles the choice draws, for the frame's triangle count. The test
+// is a handful of arithmetic per object with no state, so the same code
+// can move into the GPU culling shader unchanged.
+inline auto select_lods(const scene::Scene& scene,
+                        const std::vector<LodMesh>& meshes,
+                        const LodView& view,
+                        uint32_t* lods) -> uint64_t {
+    auto triangles = uint64_t{0};
+
+    for (auto i = size_t{0}; i < scene.size(); ++i) {
+        const auto& mesh = meshes[scene.mesh_data()[i]];
+        const auto& s = scene.transform_data()[i].scale;
+        auto scale = std::max({std::fabs(s.x), std::fabs(s.y), std::fabs(s.z)});
+
+        auto lod = select_lod(mesh, scene.bounds_data()[i], scale, view);
+        lods[i] = static_cast<uint32_t>(lod);
+        triangles += mesh.lods[lod].index_count / 3;
+    }
+
+    return triangles;
+}
+
+}
@@ -0,0 +1,285 @@
+#pragma once
+
+#include "math.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+// Meshlets: small clusters of triangles that are culled individually, much
+// finer than whole objects. The limits and layout (a list of vertex indices
+// per meshlet and 8-bit local triangle indices) are what a mesh shader
+// consumes directly; without one, cull_meshlets() is the reference of the
+// compute pass that appends the surviving triangles to an index buffer for
+// an indirect draw.
+namespace mesh {
+
+// Defaults that suit current GPUs: 64 vertices and 124 triangles keep the
+// output of one mesh shader workgroup within the 16 KiB many drivers
+// prefer.
+constexpr auto MESHLET_MAX_VERTICES = size_t{64};
+constexpr auto MESHLET_MAX_TRIANGLES = size_t{124};
+
+struct Meshlet {
+    uint32_t vertex_offset;
+    uint32_t vertex_count;
+    uint32_t triangle_offset;
+    uint32_t triangle_count;
+};
+
+// A bounding sphere and a cone containing the normals of every triangle.
+// The meshlet faces away from a viewer at position v if
+// dot(center - v, cone_axis) > cone_cutoff * length(center - v) + radius;
+// cone_cutoff is the sine of the cone's half angle, and 1 when the normals
+// spread too far for the test ever to pass.
+struct MeshletBounds {
+    math::Vec3 center;
+    float radius;
+    math::Vec3 cone_axis;
+    float cone_cutoff;
+};
+
+struct MeshletMesh {
+    std::vector<Meshlet> meshlets;
+    std::vector<MeshletBounds> bounds;
+    // Indices into the mesh's vertices, meshlet by meshlet.
+    std::vector<uint32_t> vertices;
+    // Three indices into the meshlet's vertices per triangle.
+    std::vector<uint8_t> triangles;
+};
+
+inline auto meshlet_bounds(const std::vector<math::Vec3>& positions,
+                           const MeshletMesh& mesh,
+                           const Meshlet& meshlet) -> MeshletBounds {
+    const auto* vertices = &mesh.vertices[meshlet.vertex_offset];
+    const auto* triangles = &mesh.triangles[meshlet.triangle_offset];
+
+    // Ritter's sphere: start from two far apart points, then grow to take in
+    // any point still outside.
+    auto first = positions[vertices[0]];
+    auto farthest = [&](math::Vec3 from) {
+        auto best = from;
+        auto best_distance = -1.0f;
+        for (auto i = uint32_t{0}; i < meshlet.vertex_count; ++i) {
+            auto offset = positions[vertices[i]] - from;
+            if (math::dot(offset, offset) > best_distance) {
+                best = positions[vertices[i]];
+                best_distance = math::dot(offset, offset);
+            }
+        }
+        return best;
+    };
+    auto a = farthest(first);
+    auto b = farthest(a);
+    auto center = (a + b) * 0.5f;
+    auto radius = math::length(b - a) * 0.5f;
+    for (auto i = uint32_t{0}; i < meshlet.vertex_count; ++i) {
+        auto distance = math::length(positions[vertices[i]] - center);
+        if (distance > radius) {
+            auto grown = (radius + distance) * 0.5f;
+            center = center + (positions[vertices[i]] - center) * ((grown - radius) / distance);
+            radius = grown;
+        }
+    }
+
+    auto normals = std::vector<math::Vec3>{};
+    auto axis = math::Vec3{};
+    for (auto t = uint32_t{0}; t < meshlet.triangle_count; ++t) {
+        auto p0 = positions[vertices[triangles[3 * t]]];
+        auto p1 = positions[vertices[triangles[3 * t + 1]]];
+        auto p2 = positions[vertices[triangles[3 * t + 2]]];
+        auto normal = math::cross(p1 - p0, p2 - p0);
+        auto area = math::length(normal);
+        if (area > 0) {
+            normals.push_back(normal * (1.0f / area));
+            axis = axis + normals.back();
+        }
+    }
+
+    auto bounds = MeshletBounds{center, radius, {0, 0, 0}, 1.0f};
+    if (normals.empty() or math::length(axis) <= 0) {
+        return bounds;
+    }
+
+    bounds.cone_axis = math::normalize(axis);
+    auto min_cos = 1.0f;
+    for (auto normal: normals) {
+        min_cos = std::min(min_cos, math::dot(normal, bounds.cone_axis));
+    }
+    if (min_cos > 0) {
+        bounds.cone_cutoff = std::sqrt(std::max(0.0f, 1.0f - min_cos * min_cos));
+    }
+    return bounds;
+}
+
+// Splits an indexed triangle list into meshlets. Each one is grown from a
+// seed triangle by repeatedly adding the neighbouring triangle that brings
+// in the fewest new vertices and lies closest to the meshlet's center, so
+// meshlets stay compact (tight bounds, similar normals) and share few
+// vertices with each other.
+inline auto build_meshlets(const std::vector<math::Vec3>& positions,
+                           const std::vector<uint32_t>& indices,
+                           size_t max_vertices = MESHLET_MAX_VERTICES,
+                           size_t max_triangles = MESHLET_MAX_TRIANGLES) -> MeshletMesh {
+    if (max_vertices < 3 or max_vertices > 256 or max_triangles < 1) {
+        throw std::invalid_argument("Meshlets need 3 to 256 vertices and at least one triangle");
+    }
+
+    constexpr auto NOT_IN_MESHLET = std::numeric_limits<uint32_t>::max();
+
+    auto triangle_count = indices.size() / 3;
+    auto adjacency = std::vector<std::vector<uint32_t>>(positions.size());
+    for (auto t = size_t{0}; t < triangle_count; ++t) {
+        for (auto i = 0; i < 3; ++i) {
+            adjacency[indices[3 * t + i]].push_back(static_cast<uint32_t>(t));
+        }
+    }
+
+    auto used = std::vector<uint8_t>(triangle_count, 0);
+    auto local_index = std::vector<uint32_t>(positions.size(), NOT_IN_MESHLET);
+    auto result = MeshletMesh{};
+    auto next_seed = size_t{0};
+
+    while (true) {
+        while (next_seed < triangle_count and used[next_seed]) {
+            ++next_seed;
+        }
+        if (next_seed == triangle_count) {
+            break;
+        }
+
+        auto meshlet = Meshlet{static_cast<uint32_t>(result.vertices.size()), 0,
+                               static_cast<uint32_t>(result.triangles.size()), 0};
+        auto candidates = std::vector<uint32_t>{static_cast<uint32_t>(next_seed)};
+
+        auto new_vertices = [&](uint32_t t) {
+            auto count = 0;
+            for (auto i = 0; i < 3; ++i) {
+                count += local_index[indices[3 * t + i]] == NOT_IN_MESHLET;
+            }
+            return count;
+        };
+
+        auto vertex_sum = math::Vec3{};
+        auto distance_to_center = [&](uint32_t t) {
+            auto center = vertex_sum * (1.0f / std::max(meshlet.vertex_count, uint32_t{1}));
+            auto offset = (positions[indices[3 * t]] + positions[indices[3 * t + 1]] + positions[indices[3 * t + 2]])
+                          * (1.0f / 3.0f) - center;
+            return math::dot(offset, offset);
+        };
+
+        while (meshlet.triangle_count < max_triangles) {
+            // The candidate adding the fewest vertices that still fits; of
+            // those the one closest to the meshlet's center, which keeps the
+            // meshlet round instead of growing a strip.
+            auto best = candidates.end();
+            auto best_new = 4;
+            auto best_distance = 0.0f;
+            for (auto candidate = candidates.begin(); candidate != candidates.end(); ++candidate) {
+                auto added = new_vertices(*candidate);
+                if (meshlet.vertex_count + added > max_vertices or added > best_new) {
+                    continue;
+                }
+                auto distance = distance_to_center(*candidate);
+                if (added < best_new or distance < best_distance) {
+                    best = candidate;
+                    best_new = added;
+                    best_distance = distance;
+                }
+            }
+            if (best == candidates.end()) {
+                break;
+            }
+
+            auto t = *best;
+            used[t] = 1;
+            for (auto i = 0; i < 3; ++i) {
+                auto vertex = indices[3 * t + i];
+                if (local_index[vertex] == NOT_IN_MESHLET) {
+                    local_index[vertex] = meshlet.vertex_count++;
+                    result.vertices.push_back(vertex);
+                    vertex_sum = vertex_sum + positions[vertex];
+                    for (auto neighbour: adjacency[vertex]) {
+                        if (not used[neighbour]) {
+                            candidates.push_back(neighbour);
+                        }
+                    }
+                }
+                result.triangles.push_back(static_cast<uint8_t>(local_index[vertex]));
+            }
+            ++meshlet.triangle_count;
+
+            candidates.erase(std::remove_if(candidates.begin(), candidates.end(),
+                                            [&](uint32_t candidate) { return used[candidate] != 0; }),
+                             candidates.end());
+        }
+
+        for (auto i = meshlet.vertex_offset; i < meshlet.vertex_offset + meshlet.vertex_count; ++i) {
+            local_index[result.vertices[i]] = NOT_IN_MESHLET;
+        }
+        result.meshlets.push_back(meshlet);
+    }
+
+    for (const auto& meshlet: result.meshlets) {
+        result.bounds.push_back(meshlet_bounds(positions, result, meshlet));
+    }
+    return result;
+}
+
+// Laid out like VkDrawIndexedIndirectCommand.
+struct IndirectDraw {
+    uint32_t index_count;
+    uint32_t instance_count;
+    uint32_t first_index;
+    int32_t vertex_offset;
+    uint32_t first_instance;
+};
+
+// The viewer in the mesh's own space, and the frustum as planes
+// (x, y, z) . p + w >= 0 for points inside.
+struct ClusterCullView {
+    math::Vec3 camera;
+    std::vector<math::Vec4> frustum;
+};
+
+inline auto meshlet_visible(const MeshletBounds& bounds, const ClusterCullView& view) {
+    for (const auto& plane: view.frustum) {
+        if (math::dot(plane.xyz(), bounds.center) + plane.w < -bounds.radius) {
+            return false;
+        }
+    }
+
+    auto to_center = bounds.center - view.camera;
+    return math::dot(to_center, bounds.cone_axis) <= bounds.cone_cutoff * math::length(to_center) + bounds.radius;
+}
+
+// Appends the triangles of every meshlet that survives frustum and normal
+// cone culling to indices, as indices into the mesh's vertices, and
+// returns the draw for them. The compute version runs one workgroup per
+// meshlet and reserves its range of the index buffer with an atomic add
+// on index_count.
+inline auto cull_meshlets(const MeshletMesh& mesh, const ClusterCullView& view, std::vector<uint32_t>& indices)
+        -> IndirectDraw {
+    auto draw = IndirectDraw{0, 1, static_cast<uint32_t>(indices.size()), 0, 0};
+
+    for (auto m = size_t{0}; m < mesh.meshlets.size(); ++m) {
+        if (not meshlet_visible(mesh.bounds[m], view)) {
+            continue;
+        }
+
+        const auto& meshlet = mesh.meshlets[m];
+        const auto* vertices = &mesh.vertices[meshlet.vertex_offset];
+        const auto* triangles = &mesh.triangles[meshlet.triangle_offset];
+        for (auto i = uint32_t{0}; i < 3 * meshlet.triangle_count; ++i) {
+            indices.push_back(vertices[triangles[i]]);
+        }
+        draw.index_count += 3 * meshlet.triangle_count;
+    }
+
+    return draw;
+}
+
+}
@@ -0,0 +1,382 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Metrics are updated from any thread without locks: counters and
+// histograms are split into cache-line sized per-thread shards that are only
+// summed when read, and gauges are a single relaxed atomic. The registry
+// mutex is only taken to register a metric (at startup) and to read them all
+// (from the exporter), never when recording.
+namespace metrics {
+
+constexpr auto SHARD_COUNT = size_t{8};
+constexpr auto CACHE_LINE_SIZE = size_t{64};
+
+inline auto shard_index() -> size_t {
+    static auto next_shard = std::atomic<size_t>{0};
+    thread_local auto index = next_shard.fetch_add(1, std::memory_order_relaxed) % SHARD_COUNT;
+    return index;
+}
+
+class Counter {
+public:
+    void add(uint64_t n = 1) {
+        shards[shard_index()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    auto value() const {
+        auto total = uint64_t{0};
+        for (const auto& shard: shards) {
+            total += shard.value.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+private:
+    struct alignas(CACHE_LINE_SIZE) Shard {
+        std::atomic<uint64_t> value{0};
+    };
+
+    std::array<Shard, SHARD_COUNT> shards;
+};
+
+class Gauge {
+public:
+    void set(int64_t v) {
+        current.store(v, std::memory_order_relaxed);
+    }
+
+    void add(int64_t n) {
+        current.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    auto value() const {
+        return current.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<int64_t> current{0};
+};
+
+// HDR-style log-linear histogram: values below 16 get exact buckets, above
+// that every power of two is split into 16 linear sub-buckets, so any
+// recorded value is reported within ~6% of its true value. Values are
+// clamped to 2^40 - 1 (about 12 days in microseconds).
+class Histogram {
+public:
+    constexpr static auto SUB_BUCKET_BITS = 4u;
+    constexpr static auto SUB_BUCKETS = 1u << SUB_BUCKET_BITS;
+    constexpr static auto MAX_EXPONENT = 39u;
+    constexpr static auto MAX_VALUE = (uint64_t{1} << (MAX_EXPONENT + 1)) - 1;
+    constexpr static auto BUCKET_COUNT = size_t{(MAX_EXPONENT - SUB_BUCKET_BITS + 2) * SUB_BUCKETS};
+
+    using Buckets = std::array<uint64_t, BUCKET_COUNT>;
+
+    struct Snapshot {
+        Buckets buckets{};
+        uint64_t count = 0;
+        uint64_t sum = 0;
+
+        auto mean() const {
+            return count ? static_cast<double>(sum) / static_cast<double>(count) : 0.0;
+        }
+
+        // Highest value equivalent to the bucket holding the p-th sample.
+        auto percentile(double p) const -> uint64_t {
+            if (count == 0) {
+                return 0;
+            }
+
+            auto rank = static_cast<uint64_t>(p * static_cast<double>(count - 1)) + 1;
+            auto seen = uint64_t{0};
+            for (auto i = size_t{0}; i < buckets.size(); ++i) {
+                seen += buckets[i];
+                if (seen >= rank) {
+                    return bucket_upper_bound(i);
+                }
+            }
+            return MAX_VALUE;
+        }
+    };
+
+    static auto bucket_for(uint64_t value) -> size_t {
+        value = std::min(value, MAX_VALUE);
+
+        if (value < SUB_BUCKETS) {
+            return static_cast<size_t>(value);
+        }
+
+        auto exponent = 63u - static_cast<unsigned>(__builtin_clzll(value));
+        auto shift = exponent - SUB_BUCKET_BITS;
+        auto sub_bucket = (value >> shift) & (SUB_BUCKETS - 1);
+        return static_cast<size_t>((shift + 1) * SUB_BUCKETS + sub_bucket);
+    }
+
+    static auto bucket_lower_bound(size_t bucket) -> uint64_t {
+        if (bucket < SUB_BUCKETS) {
+            return bucket;
+        }
+
+        auto shift = bucket / SUB_BUCKETS - 1;
+        return (SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+    }
+
+    static auto bucket_upper_bound(size_t bucket) -> uint64_t {
+        if (bucket + 1 >= BUCKET_COUNT) {
+            return MAX_VALUE;
+        }
+        return bucket_lower_bound(bucket + 1) - 1;
+    }
+
+    void record(uint64_t value) {
+        auto& shard = shards[shard_index()];
+        shard.buckets[bucket_for(value)].fetch_add(1, std::memory_order_relaxed);
+        shard.sum.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    template <typename Rep, typename Period>
+    void record(std::chrono::duration<Rep, Period> duration) {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+        record(static_cast<uint64_t>(std::max<decltype(us)>(us, 0)));
+    }
+
+    auto snapshot() const {
+        auto result = Snapshot{};
+        for (const auto& shard: shards) {
+            for (auto i = size_t{0}; i < BUCKET_COUNT; ++i) {
+                auto n = shard.buckets[i].load(std::memory_order_relaxed);
+                result.buckets[i] += n;
+                result.count += n;
+            }
+            result.sum += shard.sum.load(std::memory_order_relaxed);
+        }
+        return result;
+    }
+
+private:
+    struct alignas(CACHE_LINE_SIZE) Shard {
+        std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets{};
+        std::atomic<uint64_t> sum{0};
+    };
+
+    std::array<Shard, SHARD_COUNT> shards;
+};
+
+// Owns every named metric. References returned by counter()/gauge()/
+// histogram() stay valid for the registry's lifetime, so callers look a
+// metric up once and keep the reference for the hot path.
+class Registry {
+public:
+    auto counter(const std::string& name) -> Counter& {
+        return get(counters, name);
+    }
+
+    auto gauge(const std::string& name) -> Gauge& {
+        return get(gauges, name);
+    }
+
+    // Histograms record microseconds when fed a std::chrono::duration.
+    auto histogram(const std::string& name) -> Histogram& {
+        return get(histograms, name);
+    }
+
+    auto to_json() const {
+        auto lock = std::lock_guard{mutex};
+        auto timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch());
+
+        auto out = std::ostringstream{};
+        out << "{\"timestamp_ms\":" << timestamp.count();
+
+        out << ",\"counters\":{";
+        write_each(out, counters, [&](const Counter& c) { out << c.value(); });
+
+        out << "},\"gauges\":{";
+        write_each(out, gauges, [&](const Gauge& g) { out << g.value(); });
+
+        out << "},\"histograms\":{";
+        write_each(out, histograms, [&](const Histogram& h) {
+            auto s = h.snapshot();
+            out << "{\"count\":" << s.count
+                << ",\"mean\":" << s.mean()
+                << ",\"p50\":" << s.percentile(0.50)
+                << ",\"p90\":" << s.percentile(0.90)
+                << ",\"p99\":" << s.percentile(0.99)
+                << ",\"max\":" << s.percentile(1.00)
+                << '}';
+        });
+
+        out << "}}\n";
+        return out.str();
+    }
+
+private:
+    template <typename T>
+    using Map = std::map<std::string, std::unique_ptr<T>>;
+
+    template <typename T>
+    auto get(Map<T>& map, const std::string& name) -> T& {
+        auto lock = std::lock_guard{mutex};
+        auto& slot = map[name];
+        if (not slot) {
+            slot = std::make_unique<T>();
+        }
+        return *slot;
+    }
+
+    template <typename T, typename Write>
+    static void write_each(std::ostringstream& out, const Map<T>& map, Write write) {
+        auto first = true;
+        for (const auto& [name, metric]: map) {
+            out << (first ? "" : ",") << '"' << name << "\":";
+            write(*metric);
+            first = false;
+        }
+    }
+
+    mutable std::mutex mutex;
+    Map<Counter> counters;
+    Map<Gauge> gauges;
+    Map<Histogram> histograms;
+};
+
+
+// Periodically writes a JSON line with the current metrics to a file, or to
+// a Unix domain socket when the destination is given as "unix:<path>".
+class Exporter {
+public:
+    Exporter(const Registry& registry, const std::string& destination, std::chrono::milliseconds period):
+        registry{registry},
+        period{period},
+        fd{open_destination(destination)}
+    {
+        thread = std::thread{[this] { export_loop(); }};
+    }
+
+    Exporter(const Exporter&) = delete;
+    Exporter& operator=(const Exporter&) = delete;
+
+    ~Exporter() {
+        {
+            auto lock = std::lock_guard{mutex};
+            stopping = true;
+        }
+        wakeup.notify_one();
+        thread.join();
+
+        close(fd);
+    }
+
+private:
+    static auto open_destination(const std::string& destination) -> int {
+        const auto unix_prefix = std::string{"unix:"};
+
+        if (destination.compare(0, unix_prefix.size(), unix_prefix) != 0) {
+            // Opening a FIFO waits for its reader (a non-blocking open would
+            // fail with ENXIO instead); only the writes must not block.
+            auto fd = open(destination.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            if (fd < 0) {
+                throw std::runtime_error("Failed to open metrics file " + destination + ": " + std::strerror(errno));
+            }
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            return fd;
+        }
+
+        auto path = destination.substr(unix_prefix.size());
+        auto address = sockaddr_un{};
+        if (path.size() >= sizeof(address.sun_path)) {
+            throw std::runtime_error("Metrics socket path too long: " + path);
+        }
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+        auto fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0 or connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+            auto error = std::string{std::strerror(errno)};
+            if (fd >= 0) {
+                close(fd);
+            }
+            throw std::runtime_error("Failed to connect to metrics socket " + path + ": " + error);
+        }
+        return fd;
+    }
+
+    void export_loop() {
+        auto lock = std::unique_lock{mutex};
+
+        while (not stopping) {
+            wakeup.wait_for(lock, period, [this] { return stopping; });
+
+            lock.unlock();
+            write_line(registry.to_json());
+            lock.lock();
+        }
+    }
+
+    // A collector that goes away or stops reading must not take the app down
+    // or stall shutdown, so writes to a socket or FIFO never block (regular
+    // files ignore O_NONBLOCK, but their writes do not wait on a reader
+    // either). A line nothing of which could be written is dropped; the tail
+    // of a partly written one is finished before the next line so the stream
+    // stays one JSON object per line.
+    void write_line(const std::string& line) {
+        if (not unsent.empty() and not flush_unsent()) {
+            return;
+        }
+
+        unsent = line;
+        if (not flush_unsent() and unsent.size() == line.size()) {
+            unsent.clear();
+        }
+    }
+
+    auto flush_unsent() -> bool {
+        while (not unsent.empty()) {
+            auto written = send_or_write(unsent.data(), unsent.size());
+            if (written <= 0) {
+                return false;
+            }
+            unsent.erase(0, static_cast<size_t>(written));
+        }
+        return true;
+    }
+
+    auto send_or_write(const char* data, size_t size) -> ssize_t {
+        auto sent = send(fd, data, size, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0 and errno == ENOTSOCK) {
+            return write(fd, data, size);
+        }
+        return sent;
+    }
+
+    const Registry& registry;
+    std::chrono::milliseconds period;
+    int fd;
+    std::string unsent;
+
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    bool stopping = false;
+    std::thread thread;
+};
+
+}
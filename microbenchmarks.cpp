@@ -0,0 +1,336 @@
+// CPU-side microbenchmarks for the engine's hot helpers.
+//
+//     microbenchmarks [--filter <substring>] [--json <path>]
+//
+// Each benchmark is calibrated until one batch takes at least
+// MIN_BATCH_TIME, then timed over SAMPLES batches; the median time per
+// iteration is reported so a single preempted batch doesn't skew it.
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "instance_capabilities.hpp"
+#include "math.hpp"
+#include "metrics.hpp"
+#include "scene.hpp"
+#include "transform_hierarchy.hpp"
+#include "vk_result.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+// Keeps the compiler from optimizing away a value or the stores behind it.
+template <typename T>
+inline void do_not_optimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile auto sink = static_cast<const volatile void*>(nullptr);
+    sink = &value;
+#endif
+}
+
+struct BenchmarkResult {
+    std::string name;
+    uint64_t iterations;
+    double ns_per_iteration;
+};
+
+class BenchmarkRunner {
+public:
+    explicit BenchmarkRunner(std::string filter):
+        filter{std::move(filter)}
+    {}
+
+    template <typename F>
+    void run(const std::string& name, F body) {
+        if (not filter.empty() and name.find(filter) == std::string::npos) {
+            return;
+        }
+
+        auto batch = uint64_t{1};
+        while (time_batch(body, batch) < MIN_BATCH_TIME and batch < (uint64_t{1} << 40)) {
+            batch *= 2;
+        }
+
+        auto samples = std::vector<double>{};
+        for (auto i = 0; i < SAMPLES; ++i) {
+            auto elapsed = std::chrono::duration<double, std::nano>(time_batch(body, batch));
+            samples.push_back(elapsed.count() / static_cast<double>(batch));
+        }
+
+        std::nth_element(samples.begin(), samples.begin() + SAMPLES / 2, samples.end());
+        auto result = BenchmarkResult{name, batch * SAMPLES, samples[SAMPLES / 2]};
+
+        std::cout << std::left << std::setw(44) << result.name
+                  << std::right << std::setw(12) << std::fixed << std::setprecision(2)
+                  << result.ns_per_iteration << " ns/op\n";
+
+        results.push_back(std::move(result));
+    }
+
+    void write_json(const std::string& path) const {
+        auto file = std::ofstream{path, std::ios::trunc};
+        if (not file) {
+            throw std::runtime_error("Failed to open " + path);
+        }
+
+        auto timestamp = std::chrono::duration_cast<std::chrono::seconds>(
+                std::chrono::system_clock::now().time_since_epoch());
+
+        file << "{\"timestamp\":" << timestamp.count() << ",\"benchmarks\":[";
+        for (auto i = size_t{0}; i < results.size(); ++i) {
+            const auto& r = results[i];
+            file << (i ? "," : "") << "\n  {\"name\":\"" << r.name
+                 << "\",\"iterations\":" << r.iterations
+                 << ",\"ns_per_iteration\":" << r.ns_per_iteration << '}';
+        }
+        file << "\n]}\n";
+    }
+
+private:
+    constexpr static auto MIN_BATCH_TIME = std::chrono::milliseconds{20};
+    constexpr static auto SAMPLES = 7;
+
+    template <typename F>
+    static auto time_batch(F& body, uint64_t batch) {
+        auto start = Clock::now();
+        for (auto i = uint64_t{0}; i < batch; ++i) {
+            body();
+        }
+        return Clock::now() - start;
+    }
+
+    std::string filter;
+    std::vector<BenchmarkResult> results;
+};
+
+// Deterministic inputs so runs are comparable over time.
+class Random {
+public:
+    auto next() {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+
+    auto uniform(float low, float high) {
+        return low + (high - low) * static_cast<float>(next() >> 40) / static_cast<float>(1 << 24);
+    }
+
+private:
+    uint64_t state = 0x9e3779b97f4a7c15ull;
+};
+
+void benchmark_vk_result(BenchmarkRunner& runner) {
+    runner.run("vk_result_error_message/known", [] {
+        do_not_optimize(vk_result_error_message(VK_ERROR_OUT_OF_DATE_KHR));
+    });
+
+    runner.run("vk_result_error_message/unknown", [] {
+        do_not_optimize(vk_result_error_message(static_cast<VkResult>(-12345)));
+    });
+}
+
+void benchmark_instance_negotiation(BenchmarkRunner& runner) {
+    // Roughly what a desktop loader with a few layers installed reports.
+    auto capabilities = InstanceCapabilities{};
+    for (auto i = 0; i < 24; ++i) {
+        capabilities.extensions.push_back("VK_KHR_fake_extension_" + std::to_string(i));
+    }
+    capabilities.extensions.insert(capabilities.extensions.end(), {
+        "VK_KHR_surface", "VK_KHR_xcb_surface", "VK_EXT_debug_utils",
+        "VK_KHR_get_physical_device_properties2",
+    });
+    for (auto i = 0; i < 8; ++i) {
+        capabilities.layers.push_back("VK_LAYER_FAKE_" + std::to_string(i));
+    }
+    capabilities.layers.push_back("VK_LAYER_KHRONOS_validation");
+
+    auto request = InstanceRequest{};
+    request.required_extensions = {"VK_KHR_surface", "VK_KHR_xcb_surface"};
+    request.optional_extensions = {
+        "VK_KHR_get_physical_device_properties2", "VK_KHR_portability_enumeration", "VK_EXT_debug_utils",
+    };
+    request.optional_layers = {"VK_LAYER_KHRONOS_validation"};
+
+    runner.run("instance/negotiate_instance_set", [&] {
+        do_not_optimize(negotiate_instance_set(capabilities, request));
+    });
+
+    runner.run("instance/has_extension", [&] {
+        do_not_optimize(capabilities.has_extension("VK_EXT_debug_utils"));
+    });
+}
+
+void benchmark_math(BenchmarkRunner& runner) {
+    auto random = Random{};
+    auto a = math::Mat4::from_trs({1, 2, 3}, math::Quat::from_axis_angle({0, 1, 0}, 0.5f), math::Vec3{2});
+    auto b = math::Mat4::from_trs({-1, 0, 4}, math::Quat::from_axis_angle({1, 0, 0}, 1.2f), math::Vec3{0.5f});
+    auto out = math::Mat4{};
+
+    runner.run("math/mat4_multiply/simd", [&] {
+        math::multiply(a, b, out);
+        do_not_optimize(out);
+    });
+
+    runner.run("math/mat4_multiply/scalar", [&] {
+        math::multiply_scalar(a, b, out);
+        do_not_optimize(out);
+    });
+
+    auto points = math::Vec3x8{};
+    for (auto i = size_t{0}; i < math::Vec3x8::WIDTH; ++i) {
+        points.set(i, {random.uniform(-10, 10), random.uniform(-10, 10), random.uniform(-10, 10)});
+    }
+    float distances[math::Vec3x8::WIDTH];
+    auto normal = math::normalize({1, 2, 3});
+
+    runner.run("math/vec3x8_dot_plus/simd", [&] {
+        math::dot_plus(points, normal, 0.5f, distances);
+        do_not_optimize(distances);
+    });
+
+    runner.run("math/vec3x8_dot_plus/scalar", [&] {
+        math::dot_plus_scalar(points, normal, 0.5f, distances);
+        do_not_optimize(distances);
+    });
+
+    runner.run("math/vec3x8_transform_points/simd", [&] {
+        do_not_optimize(math::transform_points(a, points));
+    });
+
+    runner.run("math/vec3x8_transform_points/scalar", [&] {
+        auto result = math::Vec3x8{};
+        for (auto i = size_t{0}; i < math::Vec3x8::WIDTH; ++i) {
+            result.set(i, math::transform_point(a, points.get(i)));
+        }
+        do_not_optimize(result);
+    });
+}
+
+void benchmark_scene(BenchmarkRunner& runner) {
+    constexpr auto OBJECT_COUNT = 100'000;
+
+    auto random = Random{};
+    auto objects = scene::Scene{};
+    auto handles = std::vector<scene::ObjectHandle>{};
+    objects.reserve(OBJECT_COUNT);
+
+    for (auto i = 0; i < OBJECT_COUNT; ++i) {
+        auto desc = scene::RenderObjectDesc{};
+        desc.transform.position = {random.uniform(-100, 100), random.uniform(-100, 100), random.uniform(-100, 100)};
+        desc.bounds = {desc.transform.position, random.uniform(0.5f, 2.0f)};
+        handles.push_back(objects.create(desc));
+    }
+
+    runner.run("scene/handle_lookup", [&, i = size_t{0}]() mutable {
+        do_not_optimize(objects.transform(handles[i]));
+        i = (i + 7919) % handles.size();
+    });
+
+    // Signed distance of every bounding sphere to one plane, the inner loop
+    // of frustum culling, reported per 100k objects.
+    runner.run("scene/bounds_vs_plane_100k", [&] {
+        auto normal = math::normalize({0.3f, 0.9f, 0.1f});
+        auto visible = size_t{0};
+        objects.for_each_chunk(4096, [&](size_t begin, size_t end) {
+            const auto* bounds = objects.bounds_data();
+            for (auto i = begin; i < end; ++i) {
+                visible += math::dot(bounds[i].center, normal) + 5.0f > -bounds[i].radius;
+            }
+        });
+        do_not_optimize(visible);
+    });
+}
+
+void benchmark_transform_hierarchy(BenchmarkRunner& runner) {
+    constexpr auto NODE_COUNT = 10'000;
+
+    auto random = Random{};
+    auto hierarchy = scene::TransformHierarchy{};
+    hierarchy.add(scene::TransformHierarchy::NO_PARENT, {});
+
+    for (auto i = 1; i < NODE_COUNT; ++i) {
+        auto transform = scene::Transform{};
+        transform.position = {random.uniform(-1, 1), random.uniform(-1, 1), random.uniform(-1, 1)};
+        transform.rotation = math::Quat::from_axis_angle({0, 1, 0}, random.uniform(0, 3));
+        hierarchy.add(static_cast<uint32_t>(random.next() % static_cast<uint64_t>(i)), transform);
+    }
+    hierarchy.sort_breadth_first();
+
+    auto instances = std::vector<math::Mat4>(hierarchy.size());
+
+    runner.run("transform_hierarchy/update_all_10k", [&] {
+        hierarchy.set_local(0, hierarchy.local(0));
+        do_not_optimize(hierarchy.update(instances.data()));
+    });
+
+    runner.run("transform_hierarchy/update_clean_10k", [&] {
+        do_not_optimize(hierarchy.update(instances.data()));
+    });
+}
+
+void benchmark_metrics(BenchmarkRunner& runner) {
+    auto registry = metrics::Registry{};
+    auto& counter = registry.counter("benchmark.counter");
+    auto& histogram = registry.histogram("benchmark.histogram");
+
+    runner.run("metrics/counter_add", [&] {
+        counter.add();
+    });
+
+    runner.run("metrics/histogram_record", [&, value = uint64_t{1}]() mutable {
+        histogram.record(value);
+        value = value * 3 % 100'000;
+    });
+
+    runner.run("metrics/histogram_snapshot", [&] {
+        do_not_optimize(histogram.snapshot());
+    });
+}
+
+int main(int argc, char* argv[]) {
+    auto filter = std::string{};
+    auto json_path = std::string{};
+
+    for (auto i = 1; i < argc; ++i) {
+        auto arg = std::string{argv[i]};
+
+        if (arg == "--filter" and i + 1 < argc) {
+            filter = argv[++i];
+        } else if (arg == "--json" and i + 1 < argc) {
+            json_path = argv[++i];
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    auto runner = BenchmarkRunner{filter};
+
+    try {
+        benchmark_vk_result(runner);
+        benchmark_instance_negotiation(runner);
+        benchmark_math(runner);
+        benchmark_scene(runner);
+        benchmark_transform_hierarchy(runner);
+        benchmark_metrics(runner);
+
+        if (not json_path.empty()) {
+            runner.write_json(json_path);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
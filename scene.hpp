@@ -0,0 +1,242 @@
+#pragma once
+
+#include "math.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <vector>
+
+// Data-oriented scene store. Each component lives in its own densely packed
+// array (structure of arrays), so a pass that only touches transforms or
+// bounds streams through exactly that memory. Objects are referred to by
+// generational handles that stay valid while the dense arrays are compacted
+// underneath them; a handle to a destroyed object is detected instead of
+// silently aliasing whatever reused its slot.
+namespace scene {
+
+struct Transform {
+    math::Vec3 position;
+    math::Quat rotation;
+    math::Vec3 scale{1.0f, 1.0f, 1.0f};
+
+    auto matrix() const {
+        return math::Mat4::from_trs(position, rotation, scale);
+    }
+};
+
+struct BoundingSphere {
+    math::Vec3 center;
+    float radius;
+};
+
+using MeshHandle = uint32_t;
+using MaterialHandle = uint32_t;
+
+struct ObjectHandle {
+    uint32_t index = std::numeric_limits<uint32_t>::max();
+    uint32_t generation = 0;
+
+    friend auto operator==(ObjectHandle a, ObjectHandle b) {
+        return a.index == b.index and a.generation == b.generation;
+    }
+
+    friend auto operator!=(ObjectHandle a, ObjectHandle b) {
+        return not (a == b);
+    }
+};
+
+constexpr auto CACHE_LINE_SIZE = size_t{64};
+
+// Puts each component array on a cache line boundary; see
+// Scene::CHUNK_ALIGNMENT.
+template <typename T>
+struct CacheAlignedAllocator {
+    using value_type = T;
+
+    CacheAlignedAllocator() = default;
+
+    template <typename U>
+    CacheAlignedAllocator(const CacheAlignedAllocator<U>&) {}
+
+    auto allocate(size_t count) -> T* {
+        return static_cast<T*>(::operator new(count * sizeof(T), std::align_val_t{CACHE_LINE_SIZE}));
+    }
+
+    void deallocate(T* pointer, size_t) {
+        ::operator delete(pointer, std::align_val_t{CACHE_LINE_SIZE});
+    }
+
+    template <typename U>
+    friend auto operator==(CacheAlignedAllocator, CacheAlignedAllocator<U>) {
+        return true;
+    }
+
+    template <typename U>
+    friend auto operator!=(CacheAlignedAllocator, CacheAlignedAllocator<U>) {
+        return false;
+    }
+};
+
+template <typename T>
+using ComponentArray = std::vector<T, CacheAlignedAllocator<T>>;
+
+struct RenderObjectDesc {
+    Transform transform;
+    BoundingSphere bounds;
+    MeshHandle mesh;
+    MaterialHandle material;
+};
+
+class Scene {
+public:
+    // Chunks handed to for_each_chunk() are a multiple of this many objects.
+    // Component arrays start on a cache line, and this many of any component
+    // fill whole cache lines, so every chunk boundary is a cache line
+    // boundary and chunks can be processed by different threads without
+    // false sharing.
+    constexpr static auto CHUNK_ALIGNMENT = size_t{16};
+
+    auto create(const RenderObjectDesc& desc) -> ObjectHandle {
+        auto index = uint32_t{0};
+
+        if (free_slots.empty()) {
+            index = static_cast<uint32_t>(slots.size());
+            slots.push_back(Slot{});
+        } else {
+            index = free_slots.back();
+            free_slots.pop_back();
+        }
+
+        auto& slot = slots[index];
+        slot.dense_index = static_cast<uint32_t>(owners.size());
+
+        auto handle = ObjectHandle{index, slot.generation};
+        owners.push_back(handle);
+        transforms.push_back(desc.transform);
+        bounds.push_back(desc.bounds);
+        meshes.push_back(desc.mesh);
+        materials.push_back(desc.material);
+
+        return handle;
+    }
+
+    // Swap-removes the object's components so the arrays stay dense.
+    void destroy(ObjectHandle handle) {
+        auto dense = dense_index(handle);
+        auto last = owners.size() - 1;
+
+        if (dense != last) {
+            owners[dense] = owners[last];
+            transforms[dense] = transforms[last];
+            bounds[dense] = bounds[last];
+            meshes[dense] = meshes[last];
+            materials[dense] = materials[last];
+            slots[owners[dense].index].dense_index = static_cast<uint32_t>(dense);
+        }
+
+        owners.pop_back();
+        transforms.pop_back();
+        bounds.pop_back();
+        meshes.pop_back();
+        materials.pop_back();
+
+        auto& slot = slots[handle.index];
+        slot.generation += 1;
+        slot.dense_index = INVALID_INDEX;
+        free_slots.push_back(handle.index);
+    }
+
+    auto alive(ObjectHandle handle) const {
+        return handle.index < slots.size()
+               and slots[handle.index].generation == handle.generation
+               and slots[handle.index].dense_index != INVALID_INDEX;
+    }
+
+    auto size() const {
+        return owners.size();
+    }
+
+    auto transform(ObjectHandle handle) -> Transform& {
+        return transforms[dense_index(handle)];
+    }
+
+    auto bounding_sphere(ObjectHandle handle) -> BoundingSphere& {
+        return bounds[dense_index(handle)];
+    }
+
+    auto mesh(ObjectHandle handle) -> MeshHandle& {
+        return meshes[dense_index(handle)];
+    }
+
+    auto material(ObjectHandle handle) -> MaterialHandle& {
+        return materials[dense_index(handle)];
+    }
+
+    // Dense component arrays, all indexed by the same position. Element i of
+    // each belongs to the object owner(i).
+    auto owner(size_t i) const { return owners[i]; }
+    auto transform_data() -> Transform* { return transforms.data(); }
+    auto bounds_data() -> BoundingSphere* { return bounds.data(); }
+    auto mesh_data() -> MeshHandle* { return meshes.data(); }
+    auto material_data() -> MaterialHandle* { return materials.data(); }
+    auto transform_data() const -> const Transform* { return transforms.data(); }
+    auto bounds_data() const -> const BoundingSphere* { return bounds.data(); }
+    auto mesh_data() const -> const MeshHandle* { return meshes.data(); }
+    auto material_data() const -> const MaterialHandle* { return materials.data(); }
+
+    // Calls f(begin, end) over consecutive dense ranges. Chunks are
+    // independent, so they are the unit to hand to worker threads; until the
+    // app has a job system they run in order on the calling thread.
+    template <typename F>
+    void for_each_chunk(size_t chunk_size, F f) const {
+        chunk_size = std::max(CHUNK_ALIGNMENT, chunk_size / CHUNK_ALIGNMENT * CHUNK_ALIGNMENT);
+
+        for (auto begin = size_t{0}; begin < size(); begin += chunk_size) {
+            f(begin, std::min(begin + chunk_size, size()));
+        }
+    }
+
+    void reserve(size_t count) {
+        slots.reserve(count);
+        owners.reserve(count);
+        transforms.reserve(count);
+        bounds.reserve(count);
+        meshes.reserve(count);
+        materials.reserve(count);
+    }
+
+private:
+    constexpr static auto INVALID_INDEX = std::numeric_limits<uint32_t>::max();
+
+    struct Slot {
+        uint32_t dense_index = INVALID_INDEX;
+        uint32_t generation = 0;
+    };
+
+    auto dense_index(ObjectHandle handle) const -> size_t {
+        if (not alive(handle)) {
+            throw std::out_of_range("Stale or invalid scene object handle");
+        }
+        return slots[handle.index].dense_index;
+    }
+
+    std::vector<Slot> slots;
+    std::vector<uint32_t> free_slots;
+
+    ComponentArray<ObjectHandle> owners;
+    ComponentArray<Transform> transforms;
+    ComponentArray<BoundingSphere> bounds;
+    ComponentArray<MeshHandle> meshes;
+    ComponentArray<MaterialHandle> materials;
+
+    static_assert(CHUNK_ALIGNMENT * sizeof(ObjectHandle) % CACHE_LINE_SIZE == 0);
+    static_assert(CHUNK_ALIGNMENT * sizeof(Transform) % CACHE_LINE_SIZE == 0);
+    static_assert(CHUNK_ALIGNMENT * sizeof(BoundingSphere) % CACHE_LINE_SIZE == 0);
+    static_assert(CHUNK_ALIGNMENT * sizeof(MeshHandle) % CACHE_LINE_SIZE == 0);
+    static_assert(CHUNK_ALIGNMENT * sizeof(MaterialHandle) % CACHE_LINE_SIZE == 0);
+};
+
+}
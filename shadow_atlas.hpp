@@ -0,0 +1,345 @@
+#pragma once
+
+#include "scene.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace scene {
+
+// A square region of a shadow atlas, in texels.
+struct ShadowTile {
+    uint32_t x = 0;
+    uint32_t y = 0;
+    uint32_t size = 0;
+};
+
+// Packs square power-of-two tiles into a square atlas as a quadtree. A free
+// tile that is too large is split into four, and a freed tile is merged
+// with its three siblings once they are all free again, so the atlas does
+// not fragment as lights come and go.
+class ShadowTilePacker {
+public:
+    ShadowTilePacker(uint32_t atlas_size, uint32_t min_tile_size):
+        atlas{atlas_size},
+        min_tile{min_tile_size}
+    {
+        if (not power_of_two(atlas_size) or not power_of_two(min_tile_size) or min_tile_size > atlas_size) {
+            throw std::invalid_argument("Shadow atlas and tile sizes must be powers of two");
+        }
+
+        free_tiles.resize(level_of(min_tile_size) + 1);
+        free_tiles[0].insert({0, 0});
+    }
+
+    auto atlas_size() const {
+        return atlas;
+    }
+
+    // Returns a tile of at least the given size rounded up to a power of
+    // two, or nothing if no free tile is large enough.
+    auto allocate(uint32_t size) -> std::optional<ShadowTile> {
+        if (size > atlas) {
+            return std::nullopt;
+        }
+        auto rounded = min_tile;
+        while (rounded < size) {
+            rounded *= 2;
+        }
+        size = rounded;
+
+        auto level = level_of(size);
+        auto from = level;
+        while (free_tiles[from].empty()) {
+            if (from == 0) {
+                return std::nullopt;
+            }
+            --from;
+        }
+
+        auto [x, y] = *free_tiles[from].begin();
+        free_tiles[from].erase(free_tiles[from].begin());
+
+        while (from < level) {
+            ++from;
+            auto half = atlas >> from;
+            free_tiles[from].insert({x + half, y});
+            free_tiles[from].insert({x, y + half});
+            free_tiles[from].insert({x + half, y + half});
+        }
+
+        return ShadowTile{x, y, size};
+    }
+
+    void free(const ShadowTile& tile) {
+        auto level = level_of(tile.size);
+        auto x = tile.x;
+        auto y = tile.y;
+
+        while (level > 0) {
+            auto parent_size = atlas >> (level - 1);
+            auto half = parent_size / 2;
+            auto parent_x = x / parent_size * parent_size;
+            auto parent_y = y / parent_size * parent_size;
+
+            auto& free_level = free_tiles[level];
+            auto siblings = std::vector<std::pair<uint32_t, uint32_t>>{};
+            for (auto [sibling_x, sibling_y]: {std::pair{parent_x, parent_y}, std::pair{parent_x + half, parent_y},
+                                               std::pair{parent_x, parent_y + half},
+                                               std::pair{parent_x + half, parent_y + half}}) {
+                if (sibling_x != x or sibling_y != y) {
+                    siblings.push_back({sibling_x, sibling_y});
+                }
+            }
+
+            auto all_free = std::all_of(siblings.begin(), siblings.end(), [&](const auto& sibling) {
+                return free_level.count(sibling) != 0;
+            });
+            if (not all_free) {
+                break;
+            }
+
+            for (const auto& sibling: siblings) {
+                free_level.erase(sibling);
+            }
+            x = parent_x;
+            y = parent_y;
+            --level;
+        }
+
+        free_tiles[level].insert({x, y});
+    }
+
+    auto free_texels() const {
+        auto texels = uint64_t{0};
+        for (auto level = uint32_t{0}; level < free_tiles.size(); ++level) {
+            auto size = uint64_t{atlas >> level};
+            texels += free_tiles[level].size() * size * size;
+        }
+        return texels;
+    }
+
+private:
+    static auto power_of_two(uint32_t value) -> bool {
+        return value != 0 and (value & (value - 1)) == 0;
+    }
+
+    auto level_of(uint32_t size) const -> uint32_t {
+        auto level = uint32_t{0};
+        while ((atlas >> level) > size) {
+            ++level;
+        }
+        return level;
+    }
+
+    uint32_t atlas;
+    uint32_t min_tile;
+    // Top-left corners of the free tiles of each size; level 0 is the whole
+    // atlas and every level halves the tile size.
+    std::vector<std::set<std::pair<uint32_t, uint32_t>>> free_tiles;
+};
+
+// Shadow maps of many lights packed into one depth texture, plus a second
+// texture of the same size that caches what every light sees of the static
+// casters. A light's tile is redrawn only when the light moved or a caster
+// within its reach changed, and dynamic casters moving only re-composite
+// the tile from the static cache instead of redrawing static geometry.
+// take_updates() hands out at most one frame's budget of that work, oldest
+// first, so a burst of changes is spread over several frames.
+class ShadowAtlas {
+public:
+    using LightHandle = uint32_t;
+
+    // Work for one light. If render_static is set, the static casters are
+    // drawn into static_tile of the cache first; then static_tile is copied
+    // into tile and the dynamic casters are drawn on top.
+    struct Update {
+        LightHandle light;
+        ShadowTile tile;
+        ShadowTile static_tile;
+        bool render_static;
+    };
+
+    ShadowAtlas(uint32_t atlas_size, uint32_t min_tile_size):
+        tiles{atlas_size, min_tile_size},
+        static_tiles{atlas_size, min_tile_size}
+    {}
+
+    // reach bounds everything the light can cast a shadow onto. When the
+    // atlas has no room for the requested resolution the light gets the
+    // largest tile that still fits.
+    auto add_light(const BoundingSphere& reach, uint32_t resolution) -> LightHandle {
+        auto light = Light{};
+        light.reach = reach;
+        allocate_tiles(light, resolution);
+
+        auto handle = LightHandle{0};
+        if (free_lights.empty()) {
+            handle = static_cast<LightHandle>(lights.size());
+            lights.push_back(light);
+        } else {
+            handle = free_lights.back();
+            free_lights.pop_back();
+            lights[handle] = light;
+        }
+
+        invalidate(lights[handle], true);
+        return handle;
+    }
+
+    void remove_light(LightHandle handle) {
+        auto& light = checked(handle);
+        tiles.free(light.tile);
+        static_tiles.free(light.static_tile);
+        light = Light{};
+        free_lights.push_back(handle);
+    }
+
+    void move_light(LightHandle handle, const BoundingSphere& reach) {
+        auto& light = checked(handle);
+        light.reach = reach;
+        invalidate(light, true);
+    }
+
+    void set_resolution(LightHandle handle, uint32_t resolution) {
+        auto& light = checked(handle);
+        tiles.free(light.tile);
+        static_tiles.free(light.static_tile);
+        allocate_tiles(light, resolution);
+        invalidate(light, true);
+    }
+
+    auto tile(LightHandle handle) const -> ShadowTile {
+        return checked(handle).tile;
+    }
+
+    // bounds must cover the caster before and after the change.
+    void static_caster_changed(const BoundingSphere& bounds) {
+        invalidate_reaching(bounds, true);
+    }
+
+    void dynamic_caster_changed(const BoundingSphere& bounds) {
+        invalidate_reaching(bounds, false);
+    }
+
+    auto pending_updates() const {
+        return static_cast<size_t>(std::count_if(lights.begin(), lights.end(), [](const Light& light) {
+            return light.dirty;
+        }));
+    }
+
+    // Returns the oldest pending updates that fit into texel_budget texels
+    // drawn, counting a static redraw as a second draw of the tile. The
+    // oldest update is always returned, even if it alone exceeds the budget,
+    // so a large tile cannot starve.
+    auto take_updates(uint64_t texel_budget) -> std::vector<Update> {
+        auto pending = std::vector<LightHandle>{};
+        for (auto handle = LightHandle{0}; handle < lights.size(); ++handle) {
+            if (lights[handle].dirty) {
+                pending.push_back(handle);
+            }
+        }
+        std::sort(pending.begin(), pending.end(), [&](LightHandle a, LightHandle b) {
+            return lights[a].dirty_since < lights[b].dirty_since;
+        });
+
+        auto updates = std::vector<Update>{};
+        auto spent = uint64_t{0};
+
+        for (auto handle: pending) {
+            auto& light = lights[handle];
+            auto texels = uint64_t{light.tile.size} * light.tile.size;
+            auto cost = light.static_dirty ? 2 * texels : texels;
+
+            if (not updates.empty() and spent + cost > texel_budget) {
+                break;
+            }
+
+            updates.push_back(Update{handle, light.tile, light.static_tile, light.static_dirty});
+            spent += cost;
+            light.dirty = false;
+            light.static_dirty = false;
+        }
+
+        return updates;
+    }
+
+private:
+    struct Light {
+        BoundingSphere reach{};
+        ShadowTile tile;
+        ShadowTile static_tile;
+        bool alive = false;
+        bool dirty = false;
+        bool static_dirty = false;
+        uint64_t dirty_since = 0;
+    };
+
+    auto checked(LightHandle handle) -> Light& {
+        if (handle >= lights.size() or not lights[handle].alive) {
+            throw std::out_of_range("Invalid shadow atlas light handle");
+        }
+        return lights[handle];
+    }
+
+    auto checked(LightHandle handle) const -> const Light& {
+        return const_cast<ShadowAtlas*>(this)->checked(handle);
+    }
+
+    void allocate_tiles(Light& light, uint32_t resolution) {
+        for (auto size = std::clamp(resolution, uint32_t{1}, tiles.atlas_size()); size != 0; size /= 2) {
+            auto tile = tiles.allocate(size);
+            if (not tile) {
+                continue;
+            }
+
+            auto static_tile = static_tiles.allocate(size);
+            if (static_tile) {
+                light.tile = *tile;
+                light.static_tile = *static_tile;
+                light.alive = true;
+                return;
+            }
+            tiles.free(*tile);
+
+            if (tile->size != size) {
+                break;
+            }
+        }
+
+        throw std::runtime_error("Shadow atlas is full");
+    }
+
+    // Keeps the original age of an update that is already pending, so
+    // repeated changes cannot push it to the back of the queue.
+    void invalidate(Light& light, bool static_casters) {
+        if (not light.dirty) {
+            light.dirty = true;
+            light.dirty_since = next_stamp++;
+        }
+        light.static_dirty |= static_casters;
+    }
+
+    void invalidate_reaching(const BoundingSphere& bounds, bool static_casters) {
+        for (auto& light: lights) {
+            auto offset = light.reach.center - bounds.center;
+            auto radius = light.reach.radius + bounds.radius;
+            if (light.alive and math::dot(offset, offset) <= radius * radius) {
+                invalidate(light, static_casters);
+            }
+        }
+    }
+
+    ShadowTilePacker tiles;
+    ShadowTilePacker static_tiles;
+    std::vector<Light> lights;
+    std::vector<LightHandle> free_lights;
+    uint64_t next_stamp = 0;
+};
+
+}
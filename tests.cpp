@@ -0,0 +1,1072 @@
+// Unit tests for the engine's CPU-side helpers, run by `meson test`.
+//
+//     tests [--filter <substring>]
+//
+// A failed check is reported and the run continues; the exit status is
+// non-zero if any check failed.
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include "barrier_batch.hpp"
+#include "instance_capabilities.hpp"
+#include "math.hpp"
+#include "mesh_lod.hpp"
+#include "meshlet.hpp"
+#include "metrics.hpp"
+#include "scene.hpp"
+#include "shadow_atlas.hpp"
+#include "transform_hierarchy.hpp"
+#include "triple_buffer.hpp"
+
+namespace {
+
+auto failures = 0;
+
+void check(bool passed, const char* expression, const char* file, int line) {
+    if (not passed) {
+        ++failures;
+        std::cerr << file << ':' << line << ": check failed: " << expression << '\n';
+    }
+}
+
+template <typename Exception, typename F>
+auto throws(F f) {
+    try {
+        f();
+    } catch (const Exception&) {
+        return true;
+    }
+    return false;
+}
+
+}
+
+#define CHECK(expression) check((expression), #expression, __FILE__, __LINE__)
+
+// Vulkan handles that are never dereferenced. Non-dispatchable handles are
+// pointers on 64-bit targets and integers on 32-bit ones.
+template <typename Handle>
+auto fake_handle(uintptr_t value) {
+    return (Handle)(value);
+}
+
+void test_histogram_buckets() {
+    using metrics::Histogram;
+
+    for (auto value = uint64_t{0}; value < 2'000'000; value += value < 5000 ? 1 : 997) {
+        auto bucket = Histogram::bucket_for(value);
+        CHECK(Histogram::bucket_lower_bound(bucket) <= value);
+        CHECK(value <= Histogram::bucket_upper_bound(bucket));
+    }
+
+    for (auto bucket = size_t{0}; bucket < Histogram::BUCKET_COUNT; ++bucket) {
+        CHECK(Histogram::bucket_for(Histogram::bucket_lower_bound(bucket)) == bucket);
+        CHECK(Histogram::bucket_for(Histogram::bucket_upper_bound(bucket)) == bucket);
+    }
+
+    CHECK(Histogram::bucket_for(Histogram::MAX_VALUE) == Histogram::BUCKET_COUNT - 1);
+    CHECK(Histogram::bucket_for(~uint64_t{0}) == Histogram::BUCKET_COUNT - 1);
+}
+
+void test_histogram_percentiles() {
+    auto histogram = metrics::Histogram{};
+    CHECK(histogram.snapshot().percentile(0.5) == 0);
+
+    for (auto value = uint64_t{1}; value <= 1000; ++value) {
+        histogram.record(value);
+    }
+
+    auto snapshot = histogram.snapshot();
+    CHECK(snapshot.count == 1000);
+    CHECK(snapshot.sum == 500'500);
+    CHECK(snapshot.mean() == 500.5);
+
+    // Values are reported as their bucket's upper bound, so at most
+    // 1/SUB_BUCKETS above the exact percentile.
+    for (auto [p, exact]: {std::pair{0.5, 500.0}, {0.9, 900.0}, {0.99, 990.0}, {1.0, 1000.0}}) {
+        auto value = static_cast<double>(snapshot.percentile(p));
+        CHECK(value >= exact);
+        CHECK(value <= exact * (1.0 + 1.0 / metrics::Histogram::SUB_BUCKETS));
+    }
+
+    histogram.record(std::chrono::milliseconds{3});
+    CHECK(histogram.snapshot().percentile(1.0) >= 3000);
+}
+
+void test_scene_handles() {
+    auto objects = scene::Scene{};
+    auto handles = std::vector<scene::ObjectHandle>{};
+
+    for (auto i = 0u; i < 100; ++i) {
+        auto desc = scene::RenderObjectDesc{};
+        desc.mesh = i;
+        handles.push_back(objects.create(desc));
+    }
+
+    for (auto i = size_t{0}; i < handles.size(); i += 3) {
+        objects.destroy(handles[i]);
+    }
+
+    // Swap-remove keeps the arrays dense and every survivor's data with it.
+    CHECK(objects.size() == 66);
+    for (auto i = size_t{0}; i < handles.size(); ++i) {
+        CHECK(objects.alive(handles[i]) == (i % 3 != 0));
+        if (i % 3 != 0) {
+            CHECK(objects.mesh(handles[i]) == i);
+        }
+    }
+    for (auto i = size_t{0}; i < objects.size(); ++i) {
+        CHECK(objects.mesh(objects.owner(i)) == objects.mesh_data()[i]);
+    }
+
+    // A reused slot gets a new generation, so the old handle stays dead.
+    auto reused = objects.create({});
+    CHECK(reused.index == handles[99].index);
+    CHECK(reused.generation == handles[99].generation + 1);
+    CHECK(not objects.alive(handles[99]));
+    CHECK(objects.alive(reused));
+
+    CHECK(throws<std::out_of_range>([&] { objects.transform(handles[0]); }));
+    CHECK(throws<std::out_of_range>([&] { objects.destroy(handles[0]); }));
+    CHECK(throws<std::out_of_range>([&] { objects.mesh(scene::ObjectHandle{}); }));
+
+    for (auto data: {static_cast<const void*>(objects.transform_data()),
+                     static_cast<const void*>(objects.bounds_data()),
+                     static_cast<const void*>(objects.mesh_data())}) {
+        CHECK(reinterpret_cast<uintptr_t>(data) % scene::CACHE_LINE_SIZE == 0);
+    }
+
+    auto total = size_t{0};
+    objects.for_each_chunk(20, [&](size_t begin, size_t end) {
+        CHECK(begin % scene::Scene::CHUNK_ALIGNMENT == 0);
+        total += end - begin;
+    });
+    CHECK(total == objects.size());
+}
+
+void test_negotiate_instance_set() {
+    auto capabilities = InstanceCapabilities{};
+    capabilities.layers = {"VK_LAYER_KHRONOS_validation"};
+    capabilities.extensions = {"VK_KHR_surface", "VK_KHR_xcb_surface", "VK_EXT_debug_utils"};
+
+    auto request = InstanceRequest{};
+    request.required_extensions = {"VK_KHR_surface", "VK_KHR_xcb_surface", "VK_KHR_surface"};
+    request.optional_extensions = {"VK_EXT_debug_utils", "VK_KHR_portability_enumeration"};
+    request.optional_layers = {"VK_LAYER_KHRONOS_validation", "VK_LAYER_MISSING"};
+
+    auto enabled = negotiate_instance_set(capabilities, request);
+    CHECK(enabled.missing_required.empty());
+    CHECK(enabled.extensions.size() == 3);
+    CHECK(enabled.has_extension("VK_KHR_surface"));
+    CHECK(enabled.has_extension("VK_EXT_debug_utils"));
+    CHECK(not enabled.has_extension("VK_KHR_portability_enumeration"));
+    CHECK(enabled.has_layer("VK_LAYER_KHRONOS_validation"));
+    CHECK(enabled.layers.size() == 1);
+    CHECK(enabled.missing_optional.size() == 2);
+    CHECK(EnabledInstanceSet::contains(enabled.missing_optional, "VK_LAYER_MISSING"));
+
+    request.required_layers = {"VK_LAYER_MISSING"};
+    enabled = negotiate_instance_set(capabilities, request);
+    CHECK(enabled.missing_required.size() == 1);
+    CHECK(EnabledInstanceSet::contains(enabled.missing_required, "VK_LAYER_MISSING"));
+    CHECK(not enabled.has_layer("VK_LAYER_MISSING"));
+}
+
+void test_instance_capabilities_cache() {
+    char directory[] = "/tmp/vulkan-tutorial-tests-XXXXXX";
+    if (not mkdtemp(directory)) {
+        throw std::runtime_error("Failed to create a temporary cache directory");
+    }
+    setenv("XDG_CACHE_HOME", directory, 1);
+
+    auto path = instance_capabilities_cache_path();
+    CHECK(path == std::string{directory} + "/vulkan-tutorial-instance-capabilities");
+
+    auto loaded = InstanceCapabilities{};
+    CHECK(not load_instance_capabilities("0123456789abcdef", loaded));
+
+    auto saved = InstanceCapabilities{};
+    saved.loader_version = VK_API_VERSION_1_3;
+    saved.layers = {"VK_LAYER_KHRONOS_validation"};
+    saved.extensions = {"VK_KHR_surface", "VK_EXT_debug_utils"};
+    save_instance_capabilities(saved, "0123456789abcdef");
+
+    CHECK(load_instance_capabilities("0123456789abcdef", loaded));
+    CHECK(loaded.from_cache);
+    CHECK(loaded.loader_version == saved.loader_version);
+    CHECK(loaded.layers == saved.layers);
+    CHECK(loaded.extensions == saved.extensions);
+
+    CHECK(not load_instance_capabilities("fedcba9876543210", loaded));
+
+    // A file that doesn't parse is treated as a miss, never half-loaded.
+    auto file = std::ofstream{path, std::ios::app};
+    file << "bogus line\n";
+    file.close();
+    loaded = InstanceCapabilities{};
+    CHECK(not load_instance_capabilities("0123456789abcdef", loaded));
+    CHECK(loaded.layers.empty());
+
+    std::remove(path.c_str());
+    rmdir(directory);
+}
+
+void test_barrier_batch_images() {
+    auto image = fake_handle<VkImage>(0x1000);
+    auto batch = BarrierBatch{};
+    batch.track_image(image, VK_IMAGE_ASPECT_COLOR_BIT, 4, 2);
+
+    auto transfer_write = ResourceAccess{VK_PIPELINE_STAGE_2_COPY_BIT_KHR, VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR,
+                                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL};
+    auto transfer_read = ResourceAccess{VK_PIPELINE_STAGE_2_BLIT_BIT_KHR, VK_ACCESS_2_TRANSFER_READ_BIT_KHR,
+                                        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL};
+    auto fragment_read = ResourceAccess{VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR,
+                                        VK_ACCESS_2_SHADER_SAMPLED_READ_BIT_KHR,
+                                        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    auto compute_read = ResourceAccess{VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+                                       VK_ACCESS_2_SHADER_SAMPLED_READ_BIT_KHR,
+                                       VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+
+    // The whole image leaves UNDEFINED in one barrier that waits on nothing.
+    batch.use_image(image, transfer_write);
+    auto barriers = batch.take();
+    CHECK(barriers.images.size() == 1);
+    CHECK(barriers.buffers.empty());
+    if (barriers.images.size() == 1) {
+        const auto& barrier = barriers.images[0];
+        CHECK(barrier.srcStageMask == VK_PIPELINE_STAGE_2_NONE_KHR);
+        CHECK(barrier.srcAccessMask == VK_ACCESS_2_NONE_KHR);
+        CHECK(barrier.oldLayout == VK_IMAGE_LAYOUT_UNDEFINED);
+        CHECK(barrier.newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+        CHECK(barrier.subresourceRange.levelCount == 4);
+        CHECK(barrier.subresourceRange.layerCount == 2);
+    }
+
+    // Mip generation: mip 0 becomes a blit source, the rest stay
+    // destinations. Untouched subresources get no barrier, and mip 0's two
+    // layers share one.
+    batch.use_image(image, {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, VK_REMAINING_ARRAY_LAYERS}, transfer_read);
+    barriers = batch.take();
+    CHECK(barriers.images.size() == 1);
+    if (barriers.images.size() == 1) {
+        const auto& barrier = barriers.images[0];
+        CHECK(barrier.srcStageMask == VK_PIPELINE_STAGE_2_COPY_BIT_KHR);
+        CHECK(barrier.srcAccessMask == VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR);
+        CHECK(barrier.subresourceRange.baseMipLevel == 0);
+        CHECK(barrier.subresourceRange.levelCount == 1);
+        CHECK(barrier.subresourceRange.layerCount == 2);
+    }
+    CHECK(batch.image_layout(image, 0, 1) == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+    CHECK(batch.image_layout(image, 1, 1) == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+    // Two transitions from different states, each coalesced over its mips.
+    // Declaring the same use twice and adding a second reader merges into
+    // the same barriers.
+    batch.use_image(image, fragment_read);
+    batch.use_image(image, {VK_IMAGE_ASPECT_COLOR_BIT, 1, 3, 0, 2}, fragment_read);
+    batch.use_image(image, compute_read);
+    barriers = batch.take();
+    CHECK(barriers.images.size() == 2);
+    for (const auto& barrier: barriers.images) {
+        CHECK(barrier.newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        CHECK(barrier.dstStageMask == (VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR
+                                       | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR));
+        CHECK(barrier.subresourceRange.levelCount == (barrier.oldLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL ? 1 : 3));
+        CHECK(barrier.subresourceRange.layerCount == 2);
+    }
+
+    // Reading again in the same layout needs no barrier.
+    batch.use_image(image, fragment_read);
+    CHECK(batch.take().empty());
+
+    // Writing after those reads waits on every reader but makes nothing
+    // available.
+    batch.use_image(image, transfer_write);
+    barriers = batch.take();
+    CHECK(barriers.images.size() == 1);
+    if (barriers.images.size() == 1) {
+        CHECK(barriers.images[0].srcStageMask == (VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR
+                                                  | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR));
+        CHECK(barriers.images[0].srcAccessMask == VK_ACCESS_2_NONE_KHR);
+    }
+
+    batch.use_image(image, transfer_write);
+    CHECK(throws<std::runtime_error>([&] { batch.use_image(image, fragment_read); }));
+    batch.take();
+
+    CHECK(throws<std::out_of_range>([&] {
+        batch.use_image(image, {VK_IMAGE_ASPECT_COLOR_BIT, 3, 2, 0, 1}, fragment_read);
+    }));
+    CHECK(throws<std::out_of_range>([&] { batch.use_image(fake_handle<VkImage>(0x2000), fragment_read); }));
+
+    CHECK(throws<std::invalid_argument>([&] {
+        batch.use_image(image, {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1}, fragment_read);
+    }));
+
+    // Forgetting an image drops the uses declared for it as well.
+    batch.use_image(image, fragment_read);
+    batch.forget_image(image);
+    CHECK(batch.take().empty());
+    CHECK(throws<std::out_of_range>([&] { batch.image_layout(image, 0, 0); }));
+}
+
+void test_barrier_batch_buffers() {
+    auto buffer = fake_handle<VkBuffer>(0x3000);
+    auto batch = BarrierBatch{};
+
+    auto upload = ResourceAccess{VK_PIPELINE_STAGE_2_COPY_BIT_KHR, VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR};
+    auto vertex_read = ResourceAccess{VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT_KHR,
+                                      VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT_KHR};
+
+    // A buffer's first use has nothing to wait for.
+    batch.use_buffer(buffer, upload);
+    CHECK(batch.take().empty());
+
+    batch.use_buffer(buffer, vertex_read);
+    auto barriers = batch.take();
+    CHECK(barriers.buffers.size() == 1);
+    if (barriers.buffers.size() == 1) {
+        const auto& barrier = barriers.buffers[0];
+        CHECK(barrier.srcStageMask == VK_PIPELINE_STAGE_2_COPY_BIT_KHR);
+        CHECK(barrier.srcAccessMask == VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR);
+        CHECK(barrier.dstStageMask == VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT_KHR);
+        CHECK(barrier.size == VK_WHOLE_SIZE);
+    }
+
+    batch.use_buffer(buffer, vertex_read);
+    CHECK(batch.take().empty());
+
+    // Only the synchronization2 path is recorded here; the legacy one needs
+    // a real command buffer.
+    static auto recorded = uint32_t{0};
+    auto pipeline_barrier2 = [](VkCommandBuffer, const VkDependencyInfoKHR* dependency) {
+        recorded += dependency->bufferMemoryBarrierCount + dependency->imageMemoryBarrierCount;
+    };
+    batch.flush(VK_NULL_HANDLE, pipeline_barrier2);
+    CHECK(recorded == 0);
+    batch.use_buffer(buffer, upload);
+    batch.flush(VK_NULL_HANDLE, pipeline_barrier2);
+    CHECK(recorded == 1);
+
+    batch.use_buffer(buffer, vertex_read);
+    batch.forget_buffer(buffer);
+    CHECK(batch.take().empty());
+}
+
+void test_barrier_batch_read_after_write() {
+    auto buffer = fake_handle<VkBuffer>(0x4000);
+    auto image = fake_handle<VkImage>(0x5000);
+    auto batch = BarrierBatch{};
+    batch.track_image(image, VK_IMAGE_ASPECT_COLOR_BIT, 1, 1);
+
+    auto upload = ResourceAccess{VK_PIPELINE_STAGE_2_COPY_BIT_KHR, VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR};
+    auto vertex_read = ResourceAccess{VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT_KHR,
+                                      VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT_KHR};
+    auto storage_read = ResourceAccess{VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+                                       VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR};
+
+    // The barrier into the vertex read made the upload visible to vertex
+    // input only; a compute read in a later pass still waits on the copy.
+    batch.use_buffer(buffer, upload);
+    batch.take();
+    batch.use_buffer(buffer, vertex_read);
+    CHECK(batch.take().buffers.size() == 1);
+    batch.use_buffer(buffer, storage_read);
+    auto barriers = batch.take();
+    CHECK(barriers.buffers.size() == 1);
+    if (barriers.buffers.size() == 1) {
+        const auto& barrier = barriers.buffers[0];
+        CHECK(barrier.srcStageMask == VK_PIPELINE_STAGE_2_COPY_BIT_KHR);
+        CHECK(barrier.srcAccessMask == VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR);
+        CHECK(barrier.dstStageMask == VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR);
+        CHECK(barrier.dstAccessMask == VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR);
+    }
+
+    // Both readers are covered now.
+    batch.use_buffer(buffer, vertex_read);
+    CHECK(batch.take().empty());
+    batch.use_buffer(buffer, storage_read);
+    CHECK(batch.take().empty());
+
+    // The same stage with a different access is not.
+    batch.use_buffer(buffer, {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT_KHR});
+    CHECK(batch.take().buffers.size() == 1);
+
+    auto transfer_write = ResourceAccess{VK_PIPELINE_STAGE_2_COPY_BIT_KHR, VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR,
+                                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL};
+    auto fragment_read = ResourceAccess{VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR,
+                                        VK_ACCESS_2_SHADER_SAMPLED_READ_BIT_KHR,
+                                        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    auto compute_read = ResourceAccess{VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+                                       VK_ACCESS_2_SHADER_SAMPLED_READ_BIT_KHR,
+                                       VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+
+    // Same for an image whose layout stays put after the first read: the
+    // compute read waits on the copy and on the layout transition.
+    batch.use_image(image, transfer_write);
+    batch.take();
+    batch.use_image(image, fragment_read);
+    CHECK(batch.take().images.size() == 1);
+    batch.use_image(image, compute_read);
+    barriers = batch.take();
+    CHECK(barriers.images.size() == 1);
+    if (barriers.images.size() == 1) {
+        const auto& barrier = barriers.images[0];
+        CHECK(barrier.srcStageMask == (VK_PIPELINE_STAGE_2_COPY_BIT_KHR
+                                       | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR));
+        CHECK(barrier.srcAccessMask == VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR);
+        CHECK(barrier.dstStageMask == VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR);
+        CHECK(barrier.oldLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        CHECK(barrier.newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    }
+    batch.use_image(image, fragment_read);
+    CHECK(batch.take().empty());
+    batch.use_image(image, compute_read);
+    CHECK(batch.take().empty());
+
+    // A write after synchronized reads waits on the readers only.
+    batch.use_image(image, transfer_write);
+    barriers = batch.take();
+    CHECK(barriers.images.size() == 1);
+    if (barriers.images.size() == 1) {
+        CHECK(barriers.images[0].srcStageMask == (VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR
+                                                  | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR));
+        CHECK(barriers.images[0].srcAccessMask == VK_ACCESS_2_NONE_KHR);
+    }
+}
+
+void test_legacy_barrier_masks() {
+    CHECK(legacy_stage_mask(VK_PIPELINE_STAGE_2_NONE_KHR) == 0);
+    CHECK(legacy_stage_mask(VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR) == VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+    CHECK(legacy_stage_mask(VK_PIPELINE_STAGE_2_COPY_BIT_KHR | VK_PIPELINE_STAGE_2_CLEAR_BIT_KHR)
+          == VK_PIPELINE_STAGE_TRANSFER_BIT);
+    CHECK(legacy_stage_mask(VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT_KHR) == VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+    CHECK(legacy_stage_mask(VK_PIPELINE_STAGE_2_PRE_RASTERIZATION_SHADERS_BIT_KHR)
+          == VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT);
+
+    CHECK(legacy_access_mask(VK_ACCESS_2_SHADER_SAMPLED_READ_BIT_KHR) == VK_ACCESS_SHADER_READ_BIT);
+    CHECK(legacy_access_mask(VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR | VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR)
+          == (VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT));
+}
+
+void test_triple_buffer() {
+    auto buffer = TripleBuffer<int>{};
+    CHECK(not buffer.update());
+
+    buffer.back() = 1;
+    buffer.publish();
+    CHECK(buffer.update());
+    CHECK(buffer.front() == 1);
+    CHECK(not buffer.update());
+    CHECK(buffer.front() == 1);
+
+    // The reader skips straight to the newest publish.
+    for (auto value = 2; value <= 4; ++value) {
+        buffer.back() = value;
+        buffer.publish();
+    }
+    CHECK(buffer.update());
+    CHECK(buffer.front() == 4);
+
+    // Across threads, the reader only ever sees complete, newer states.
+    struct State {
+        uint64_t a = 0;
+        uint64_t b = 0;
+    };
+    constexpr auto PUBLISHES = uint64_t{200'000};
+
+    auto states = TripleBuffer<State>{};
+    auto writer = std::thread{[&] {
+        for (auto i = uint64_t{1}; i <= PUBLISHES; ++i) {
+            states.back() = State{i, ~i};
+            states.publish();
+        }
+    }};
+
+    auto last = uint64_t{0};
+    auto torn = false;
+    auto backwards = false;
+    while (last != PUBLISHES) {
+        if (states.update()) {
+            const auto& state = states.front();
+            torn = torn or state.b != ~state.a;
+            backwards = backwards or state.a <= last;
+            last = state.a;
+        }
+    }
+    writer.join();
+
+    CHECK(not torn);
+    CHECK(not backwards);
+}
+
+// The constexpr claims in math.hpp, checked at compile time.
+static_assert(math::dot(math::cross(math::Vec3{1, 0, 0}, math::Vec3{0, 1, 0}), math::Vec3{0, 0, 1}) == 1);
+static_assert((math::Quat{0, 0, 1, 0} * math::Quat{0, 0, 1, 0}).w == -1);
+static_assert(math::rotate(math::Quat{0, 0, 1, 0}, math::Vec3{1, 2, 3}).x == -1);
+static_assert(math::transform_point(math::Mat4::translation({1, 2, 3}), math::Vec3{1, 1, 1}).z == 4);
+static_assert(math::transform_point(math::Mat4::from_trs({1, 2, 3}, {}, {2, 2, 2}), math::Vec3{1, 1, 1}).y == 4);
+static_assert(math::Vec3x8{}.get(7).x == 0);
+
+auto near(float a, float b) {
+    return std::fabs(a - b) <= 1e-4f * std::fmax(1.0f, std::fmax(std::fabs(a), std::fabs(b)));
+}
+
+auto near(math::Vec3 a, math::Vec3 b) {
+    return near(a.x, b.x) and near(a.y, b.y) and near(a.z, b.z);
+}
+
+auto near(const math::Mat4& a, const math::Mat4& b) {
+    for (auto i = 0; i < 16; ++i) {
+        if (not near(a.data()[i], b.data()[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Deterministic, non-trivial values for the SIMD-versus-scalar checks.
+auto test_value(int i) {
+    return std::sin(float(i) * 1.37f + 0.5f) * 10.0f;
+}
+
+void test_math_matrix_product() {
+    using namespace math;
+
+    auto a = Mat4{};
+    auto b = Mat4{};
+    for (auto i = 0; i < 16; ++i) {
+        (&a.columns[0].x)[i] = test_value(i);
+        (&b.columns[0].x)[i] = test_value(i + 16);
+    }
+
+    auto simd = Mat4{};
+    auto scalar = Mat4{};
+    multiply(a, b, simd);
+    multiply_scalar(a, b, scalar);
+    CHECK(near(simd, scalar));
+    CHECK(near(a * b, scalar));
+
+    // from_trs builds the same matrix as the product it stands for.
+    auto t = Vec3{1.5f, -2.0f, 3.25f};
+    auto q = Quat::from_axis_angle({1, 2, -0.5f}, 0.7f);
+    auto s = Vec3{2.0f, 0.5f, 3.0f};
+    auto r = Mat4::from_trs({}, q, Vec3{1});
+    CHECK(near(Mat4::from_trs(t, q, s), Mat4::translation(t) * r * Mat4::scale(s)));
+
+    // The rotation part agrees with rotating by the quaternion.
+    auto p = Vec3{0.3f, -4.0f, 2.0f};
+    CHECK(near(transform_point(r, p), rotate(q, p)));
+}
+
+void test_math_quaternions() {
+    using namespace math;
+
+    auto a = Quat::from_axis_angle({0, 0, 1}, 0.9f);
+    auto b = Quat::from_axis_angle({1, -1, 2}, -2.1f);
+    auto v = Vec3{1.0f, 2.0f, -3.0f};
+
+    // A product rotates by the right operand first.
+    CHECK(near(rotate(a * b, v), rotate(a, rotate(b, v))));
+
+    // A quarter turn about z takes x to y, and rotations keep lengths.
+    auto quarter = Quat::from_axis_angle({0, 0, 1}, std::acos(-1.0f) * 0.5f);
+    CHECK(near(rotate(quarter, {1, 0, 0}), Vec3{0, 1, 0}));
+    CHECK(near(length(rotate(b, v)), length(v)));
+
+    auto identity = a * Quat{-a.x, -a.y, -a.z, a.w};
+    CHECK(near(identity.w, 1) and near(Vec3{identity.x, identity.y, identity.z}, Vec3{}));
+}
+
+void test_math_batch_kernels() {
+    using namespace math;
+
+    auto points = Vec3x8{};
+    for (auto i = size_t{0}; i < Vec3x8::WIDTH; ++i) {
+        points.set(i, {test_value(3 * int(i)), test_value(3 * int(i) + 1), test_value(3 * int(i) + 2)});
+    }
+
+    auto normal = normalize({0.2f, -0.7f, 0.4f});
+    float simd[Vec3x8::WIDTH];
+    float scalar[Vec3x8::WIDTH];
+    dot_plus(points, normal, -1.5f, simd);
+    dot_plus_scalar(points, normal, -1.5f, scalar);
+    for (auto i = size_t{0}; i < Vec3x8::WIDTH; ++i) {
+        CHECK(near(simd[i], scalar[i]));
+    }
+
+    auto m = Mat4::from_trs({4, -5, 6}, Quat::from_axis_angle({0.3f, 1, 0.2f}, 1.1f), {1.5f, 2, 0.5f});
+    auto transformed = transform_points(m, points);
+    for (auto i = size_t{0}; i < Vec3x8::WIDTH; ++i) {
+        CHECK(near(transformed.get(i), transform_point(m, points.get(i))));
+    }
+}
+
+void test_transform_hierarchy() {
+    using scene::TransformHierarchy;
+    using scene::Transform;
+
+    auto translation = [](const math::Mat4& m) { return m.columns[3].xyz(); };
+
+    // Added depth first, so sorting breadth first reorders it:
+    //
+    //     0 -+- 1 -+- 2
+    //        |     +- 3
+    //        +- 4 --- 5
+    auto hierarchy = TransformHierarchy{};
+    auto parents = std::vector<uint32_t>{TransformHierarchy::NO_PARENT, 0, 1, 1, 0, 4};
+    auto offsets = std::vector<math::Vec3>{{1, 0, 0}, {0, 1, 0}, {0, 0, 1}, {2, 0, 0}, {0, 0, 5}, {0, 3, 0}};
+    for (auto node = size_t{0}; node < parents.size(); ++node) {
+        CHECK(hierarchy.add(parents[node], Transform{offsets[node]}) == node);
+    }
+    CHECK(throws<std::out_of_range>([&] { hierarchy.add(7, Transform{}); }));
+    CHECK(hierarchy.size() == 6);
+
+    CHECK(hierarchy.update() == 6);
+    CHECK(hierarchy.update() == 0);
+
+    // Dirtying a mid-tree node recomputes exactly its subtree.
+    offsets[1] = {0, 10, 0};
+    hierarchy.set_local(1, Transform{offsets[1]});
+    CHECK(hierarchy.update() == 3);
+    CHECK(near(translation(hierarchy.world(1)), math::Vec3{1, 10, 0}));
+    CHECK(near(translation(hierarchy.world(2)), math::Vec3{1, 10, 1}));
+    CHECK(near(translation(hierarchy.world(3)), math::Vec3{3, 10, 0}));
+    CHECK(near(translation(hierarchy.world(5)), math::Vec3{1, 3, 5}));
+
+    // With nothing dirty, every instance slot is still filled.
+    auto instances = std::vector<math::Mat4>(hierarchy.size(), math::Mat4::scale(math::Vec3{0}));
+    CHECK(hierarchy.update(instances.data()) == 0);
+    for (auto node = uint32_t{0}; node < hierarchy.size(); ++node) {
+        CHECK(near(instances[node], hierarchy.world(node)));
+    }
+
+    auto before = std::vector<math::Mat4>{};
+    for (auto node = uint32_t{0}; node < hierarchy.size(); ++node) {
+        before.push_back(hierarchy.world(node));
+    }
+
+    auto remap = hierarchy.sort_breadth_first();
+    CHECK((remap == std::vector<uint32_t>{0, 1, 3, 4, 2, 5}));
+    for (auto old_node = uint32_t{0}; old_node < remap.size(); ++old_node) {
+        auto node = remap[old_node];
+        auto parent = hierarchy.parent(node);
+        if (parents[old_node] == TransformHierarchy::NO_PARENT) {
+            CHECK(parent == TransformHierarchy::NO_PARENT);
+        } else {
+            CHECK(parent == remap[parents[old_node]]);
+            CHECK(parent < node);
+        }
+        CHECK(near(hierarchy.world(node), before[old_node]));
+        CHECK(near(hierarchy.local(node).position, offsets[old_node]));
+    }
+
+    // The sorted hierarchy still updates subtrees through the new indices.
+    hierarchy.set_local(remap[4], Transform{{0, 0, -5}});
+    CHECK(hierarchy.update() == 2);
+    CHECK(near(translation(hierarchy.world(remap[5])), math::Vec3{1, 3, -5}));
+}
+
+void test_shadow_tile_packer() {
+    using scene::ShadowTile;
+
+    auto packer = scene::ShadowTilePacker{1024, 64};
+    CHECK(throws<std::invalid_argument>([] { scene::ShadowTilePacker{1000, 64}; }));
+
+    // Sizes round up to a power of two of at least the minimum tile.
+    auto tiles = std::vector<ShadowTile>{};
+    for (auto size: {512u, 300u, 256u, 100u, 10u, 64u}) {
+        auto tile = packer.allocate(size);
+        CHECK(tile.has_value());
+        if (tile) {
+            tiles.push_back(*tile);
+        }
+    }
+    auto sizes = std::vector<uint32_t>{};
+    for (const auto& tile: tiles) {
+        sizes.push_back(tile.size);
+    }
+    CHECK((sizes == std::vector<uint32_t>{512, 512, 256, 128, 64, 64}));
+
+    // Tiles never overlap and stay inside the atlas.
+    for (auto i = size_t{0}; i < tiles.size(); ++i) {
+        CHECK(tiles[i].x + tiles[i].size <= 1024 and tiles[i].y + tiles[i].size <= 1024);
+        CHECK(tiles[i].x % tiles[i].size == 0 and tiles[i].y % tiles[i].size == 0);
+        for (auto j = i + 1; j < tiles.size(); ++j) {
+            auto apart = tiles[i].x + tiles[i].size <= tiles[j].x or tiles[j].x + tiles[j].size <= tiles[i].x
+                         or tiles[i].y + tiles[i].size <= tiles[j].y or tiles[j].y + tiles[j].size <= tiles[i].y;
+            CHECK(apart);
+        }
+    }
+
+    CHECK(packer.free_texels() == 1024 * 1024 - 2 * 512 * 512 - 256 * 256 - 128 * 128 - 2 * 64 * 64);
+    CHECK(not packer.allocate(1024).has_value());
+    CHECK(not packer.allocate(2048).has_value());
+
+    // The last quadrant is still whole.
+    auto last = packer.allocate(512);
+    CHECK(last.has_value());
+    CHECK(not packer.allocate(512).has_value());
+    if (last) {
+        tiles.push_back(*last);
+    }
+
+    // Freeing everything merges the atlas back into one tile.
+    for (const auto& tile: tiles) {
+        packer.free(tile);
+    }
+    CHECK(packer.free_texels() == 1024 * 1024);
+    auto whole = packer.allocate(1024);
+    CHECK(whole.has_value() and whole->x == 0 and whole->y == 0);
+}
+
+void test_shadow_atlas() {
+    using scene::BoundingSphere;
+    using scene::ShadowAtlas;
+
+    auto atlas = ShadowAtlas{2048, 128};
+    auto left = atlas.add_light(BoundingSphere{{-10, 0, 0}, 5}, 1024);
+    auto right = atlas.add_light(BoundingSphere{{10, 0, 0}, 5}, 1024);
+    CHECK(atlas.tile(left).size == 1024);
+
+    // New lights render their static casters first; one 1024 tile costs
+    // two draws, so a budget of three fits only the older light.
+    CHECK(atlas.pending_updates() == 2);
+    auto updates = atlas.take_updates(3 * 1024 * 1024);
+    CHECK(updates.size() == 1);
+    CHECK(updates.size() == 1 and updates[0].light == left and updates[0].render_static);
+    updates = atlas.take_updates(3 * 1024 * 1024);
+    CHECK(updates.size() == 1 and updates[0].light == right);
+    CHECK(atlas.take_updates(~uint64_t{0}).empty());
+
+    // A dynamic caster re-composites from the cache, a static one redraws
+    // the cache, and casters out of every light's reach cost nothing.
+    atlas.dynamic_caster_changed(BoundingSphere{{-6, 0, 0}, 1});
+    atlas.static_caster_changed(BoundingSphere{{14, 1, 0}, 1});
+    atlas.dynamic_caster_changed(BoundingSphere{{0, 0, 0}, 1});
+    updates = atlas.take_updates(~uint64_t{0});
+    CHECK(updates.size() == 2);
+    if (updates.size() == 2) {
+        CHECK(updates[0].light == left and not updates[0].render_static);
+        CHECK(updates[1].light == right and updates[1].render_static);
+        CHECK(updates[0].tile.x == atlas.tile(left).x and updates[0].tile.y == atlas.tile(left).y);
+    }
+
+    // A pending update keeps its age, and an oversized one still goes out.
+    atlas.move_light(right, BoundingSphere{{12, 0, 0}, 5});
+    atlas.dynamic_caster_changed(BoundingSphere{{-10, 0, 0}, 1});
+    atlas.dynamic_caster_changed(BoundingSphere{{12, 0, 0}, 1});
+    updates = atlas.take_updates(1);
+    CHECK(updates.size() == 1 and updates[0].light == right and updates[0].render_static);
+
+    // A full atlas hands out smaller tiles, and removed lights free theirs.
+    auto big = atlas.add_light(BoundingSphere{}, 2048);
+    CHECK(atlas.tile(big).size == 1024);
+    auto small = atlas.add_light(BoundingSphere{}, 1024);
+    CHECK(atlas.tile(small).size == 1024);
+    CHECK(throws<std::runtime_error>([&] { atlas.add_light(BoundingSphere{}, 128); }));
+    atlas.remove_light(big);
+    CHECK(throws<std::out_of_range>([&] { atlas.tile(big); }));
+    atlas.set_resolution(small, 256);
+    CHECK(atlas.tile(small).size == 256);
+    CHECK(atlas.tile(atlas.add_light(BoundingSphere{}, 1024)).size == 1024);
+}
+
+// Unit sphere made by subdividing an octahedron, wound counter-clockwise
+// seen from outside.
+void sphere_mesh(int subdivisions, std::vector<math::Vec3>& positions, std::vector<uint32_t>& indices) {
+    positions = {{1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}};
+    indices = {0, 2, 4, 2, 1, 4, 1, 3, 4, 3, 0, 4, 2, 0, 5, 1, 2, 5, 3, 1, 5, 0, 3, 5};
+
+    for (auto level = 0; level < subdivisions; ++level) {
+        auto midpoints = std::map<std::pair<uint32_t, uint32_t>, uint32_t>{};
+        auto midpoint = [&](uint32_t a, uint32_t b) {
+            auto key = std::pair{std::min(a, b), std::max(a, b)};
+            auto found = midpoints.find(key);
+            if (found != midpoints.end()) {
+                return found->second;
+            }
+            positions.push_back(math::normalize((positions[a] + positions[b]) * 0.5f));
+            return midpoints[key] = static_cast<uint32_t>(positions.size() - 1);
+        };
+
+        auto finer = std::vector<uint32_t>{};
+        for (auto i = size_t{0}; i < indices.size(); i += 3) {
+            auto a = indices[i], b = indices[i + 1], c = indices[i + 2];
+            auto ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+            finer.insert(finer.end(), {a, ab, ca, b, bc, ab, c, ca, bc, ab, bc, ca});
+        }
+        indices = std::move(finer);
+    }
+}
+
+void test_mesh_simplify() {
+    // A flat grid simplifies with no error and keeps its corners.
+    constexpr auto SIDE = uint32_t{17};
+    auto positions = std::vector<math::Vec3>{};
+    auto indices = std::vector<uint32_t>{};
+    for (auto y = uint32_t{0}; y < SIDE; ++y) {
+        for (auto x = uint32_t{0}; x < SIDE; ++x) {
+            positions.push_back({float(x), float(y), 0});
+        }
+    }
+    for (auto y = uint32_t{0}; y + 1 < SIDE; ++y) {
+        for (auto x = uint32_t{0}; x + 1 < SIDE; ++x) {
+            auto i = y * SIDE + x;
+            indices.insert(indices.end(), {i, i + 1, i + SIDE, i + 1, i + SIDE + 1, i + SIDE});
+        }
+    }
+
+    auto error = -1.0f;
+    auto flat = mesh::simplify(positions, indices, 6, &error);
+    CHECK(flat.size() < indices.size() / 10);
+    CHECK(error >= 0 and error < 1e-3f);
+    for (auto corner: {uint32_t{0}, SIDE - 1, SIDE * (SIDE - 1), SIDE * SIDE - 1}) {
+        CHECK(std::find(flat.begin(), flat.end(), corner) != flat.end());
+    }
+
+    // A sphere loses detail gradually without turning any triangle inside
+    // out, and every level stays within its reported error.
+    sphere_mesh(4, positions, indices);
+    auto chain = mesh::build_lod_chain(positions, indices, {0.5f, 0.25f, 0.1f});
+    CHECK(chain.lods.size() == 4);
+    CHECK(chain.lods[0].index_count == indices.size() and chain.lods[0].error == 0);
+
+    auto ratios = std::vector<float>{1.0f, 0.5f, 0.25f, 0.1f};
+    for (auto lod = size_t{0}; lod < chain.lods.size(); ++lod) {
+        const auto& level = chain.lods[lod];
+        CHECK(level.index_count % 3 == 0);
+        CHECK(level.index_count <= indices.size() * ratios[lod] + 3);
+        CHECK(level.first_index + level.index_count <= chain.indices.size());
+        if (lod > 0) {
+            CHECK(level.index_count < chain.lods[lod - 1].index_count);
+            CHECK(level.error >= chain.lods[lod - 1].error);
+        }
+
+        auto inverted = 0;
+        for (auto i = level.first_index; i < level.first_index + level.index_count; i += 3) {
+            CHECK(chain.indices[i] < positions.size());
+            auto a = chain.positions[chain.indices[i]];
+            auto b = chain.positions[chain.indices[i + 1]];
+            auto c = chain.positions[chain.indices[i + 2]];
+            auto normal = math::cross(b - a, c - a);
+            auto center = (a + b + c) * (1.0f / 3.0f);
+            if (math::dot(normal, center) < -0.1f * math::length(normal) * math::length(center)) {
+                ++inverted;
+            }
+            CHECK(1.0f - math::length(center) <= level.error + 1e-2f);
+        }
+        CHECK(inverted == 0);
+    }
+    CHECK(chain.lods.back().error > 0 and chain.lods.back().error < 0.5f);
+}
+
+void test_mesh_lod_selection() {
+    auto positions = std::vector<math::Vec3>{};
+    auto indices = std::vector<uint32_t>{};
+    sphere_mesh(3, positions, indices);
+    auto chain = mesh::build_lod_chain(positions, indices, {0.5f, 0.25f, 0.1f});
+    auto last = chain.lods.size() - 1;
+
+    auto view = mesh::LodView{{0, 0, 0}, mesh::projection_scale(1.0f, 1080.0f), 1.0f};
+    auto at = [](float distance) { return scene::BoundingSphere{{0, 0, -distance}, 1.0f}; };
+
+    CHECK(mesh::select_lod(chain, at(0.5f), 1.0f, view) == 0);
+    CHECK(mesh::select_lod(chain, at(2.0f), 1.0f, view) == 0);
+    CHECK(mesh::select_lod(chain, at(1e5f), 1.0f, view) == last);
+
+    // Farther never means finer, and a larger object or a stricter error
+    // never means coarser.
+    auto previous = size_t{0};
+    for (auto distance = 2.0f; distance < 1e5f; distance *= 1.5f) {
+        auto lod = mesh::select_lod(chain, at(distance), 1.0f, view);
+        CHECK(lod >= previous);
+        CHECK(mesh::select_lod(chain, at(distance), 4.0f, view) <= lod);
+        auto strict = view;
+        strict.max_pixel_error = 0.25f;
+        CHECK(mesh::select_lod(chain, at(distance), 1.0f, strict) <= lod);
+        previous = lod;
+    }
+
+    // The culling pass totals the triangles of the chosen levels.
+    auto meshes = std::vector<mesh::LodMesh>{chain};
+    auto world = scene::Scene{};
+    world.create(scene::RenderObjectDesc{{}, at(2.0f), 0, 0});
+    world.create(scene::RenderObjectDesc{{}, at(1e5f), 0, 0});
+    auto lods = std::vector<uint32_t>(world.size());
+    auto triangles = mesh::select_lods(world, meshes, view, lods.data());
+    CHECK(lods[0] == 0 and lods[1] == last);
+    CHECK(triangles == (chain.lods[0].index_count + chain.lods[last].index_count) / 3);
+}
+
+void test_meshlets() {
+    auto positions = std::vector<math::Vec3>{};
+    auto indices = std::vector<uint32_t>{};
+    sphere_mesh(5, positions, indices);
+    auto triangle_count = indices.size() / 3;
+
+    CHECK(throws<std::invalid_argument>([&] { mesh::build_meshlets(positions, indices, 300, 124); }));
+
+    auto meshlets = mesh::build_meshlets(positions, indices);
+    CHECK(meshlets.bounds.size() == meshlets.meshlets.size());
+    // Compact meshlets average well over 64 triangles for 64 vertices; a
+    // strip-like split stays below that.
+    CHECK(meshlets.meshlets.size() * 64 <= triangle_count);
+
+    // Every triangle ends up in exactly one meshlet, with its winding.
+    auto rotated = [](uint32_t a, uint32_t b, uint32_t c) {
+        auto first = std::min({a, b, c});
+        return first == a ? std::array{a, b, c} : first == b ? std::array{b, c, a} : std::array{c, a, b};
+    };
+    auto expected = std::vector<std::array<uint32_t, 3>>{};
+    for (auto i = size_t{0}; i < indices.size(); i += 3) {
+        expected.push_back(rotated(indices[i], indices[i + 1], indices[i + 2]));
+    }
+    auto found = std::vector<std::array<uint32_t, 3>>{};
+
+    for (auto m = size_t{0}; m < meshlets.meshlets.size(); ++m) {
+        const auto& meshlet = meshlets.meshlets[m];
+        const auto& bounds = meshlets.bounds[m];
+        CHECK(meshlet.vertex_count <= mesh::MESHLET_MAX_VERTICES);
+        CHECK(meshlet.triangle_count <= mesh::MESHLET_MAX_TRIANGLES);
+
+        const auto* vertices = &meshlets.vertices[meshlet.vertex_offset];
+        for (auto v = uint32_t{0}; v < meshlet.vertex_count; ++v) {
+            CHECK(math::length(positions[vertices[v]] - bounds.center) <= bounds.radius * 1.0001f);
+        }
+
+        // A sphere's meshlets are nearly flat, so every cone is usable.
+        CHECK(bounds.cone_cutoff < 0.6f);
+        auto min_cos = std::sqrt(1.0f - bounds.cone_cutoff * bounds.cone_cutoff);
+
+        for (auto t = uint32_t{0}; t < meshlet.triangle_count; ++t) {
+            const auto* local = &meshlets.triangles[meshlet.triangle_offset + 3 * t];
+            CHECK(local[0] < meshlet.vertex_count and local[1] < meshlet.vertex_count
+                  and local[2] < meshlet.vertex_count);
+            auto a = vertices[local[0]], b = vertices[local[1]], c = vertices[local[2]];
+            found.push_back(rotated(a, b, c));
+
+            auto normal = math::normalize(math::cross(positions[b] - positions[a], positions[c] - positions[a]));
+            CHECK(math::dot(normal, bounds.cone_axis) >= min_cos - 1e-4f);
+        }
+    }
+    std::sort(expected.begin(), expected.end());
+    std::sort(found.begin(), found.end());
+    CHECK(found == expected);
+}
+
+void test_meshlet_culling() {
+    auto positions = std::vector<math::Vec3>{};
+    auto indices = std::vector<uint32_t>{};
+    sphere_mesh(5, positions, indices);
+    auto meshlets = mesh::build_meshlets(positions, indices);
+
+    // Culling is conservative: every triangle facing the viewer, and inside
+    // the frustum, is drawn; a good part of the back is not.
+    auto check_view = [&](const mesh::ClusterCullView& view) {
+        auto drawn = std::vector<uint32_t>{7, 7, 7};
+        auto draw = mesh::cull_meshlets(meshlets, view, drawn);
+        CHECK(draw.first_index == 3 and draw.instance_count == 1 and draw.vertex_offset == 0);
+        CHECK(draw.index_count == drawn.size() - 3);
+
+        auto kept = std::set<std::array<uint32_t, 3>>{};
+        for (auto i = size_t{3}; i < drawn.size(); i += 3) {
+            kept.insert({drawn[i], drawn[i + 1], drawn[i + 2]});
+        }
+
+        auto front_facing = size_t{0};
+        for (auto i = size_t{0}; i < indices.size(); i += 3) {
+            auto a = positions[indices[i]], b = positions[indices[i + 1]], c = positions[indices[i + 2]];
+            auto center = (a + b + c) * (1.0f / 3.0f);
+            auto inside = std::all_of(view.frustum.begin(), view.frustum.end(), [&](const math::Vec4& plane) {
+                return math::dot(plane.xyz(), center) + plane.w >= 0;
+            });
+            if (math::dot(math::cross(b - a, c - a), view.camera - a) > 0 and inside) {
+                ++front_facing;
+                CHECK(kept.count({indices[i], indices[i + 1], indices[i + 2]}) == 1);
+            }
+        }
+        CHECK(draw.index_count / 3 < indices.size() / 3);
+        return std::pair{front_facing, size_t{draw.index_count / 3}};
+    };
+
+    auto [front, drawn] = check_view(mesh::ClusterCullView{{0, 0, 10}, {}});
+    CHECK(drawn < indices.size() / 3 * 3 / 4);
+    CHECK(front > 0 and drawn >= front);
+
+    // The half space x >= 0.5 keeps a smaller cap of the sphere.
+    auto [front_in_frustum, drawn_in_frustum] = check_view(mesh::ClusterCullView{{0, 0, 10}, {{1, 0, 0, -0.5f}}});
+    CHECK(drawn_in_frustum < drawn);
+    CHECK(front_in_frustum > 0);
+}
+
+int main(int argc, char* argv[]) {
+    auto filter = std::string{};
+
+    for (auto i = 1; i < argc; ++i) {
+        auto arg = std::string{argv[i]};
+
+        if (arg == "--filter" and i + 1 < argc) {
+            filter = argv[++i];
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    auto tests = std::vector<std::pair<std::string, void (*)()>>{
+        {"histogram_buckets", test_histogram_buckets},
+        {"histogram_percentiles", test_histogram_percentiles},
+        {"scene_handles", test_scene_handles},
+        {"negotiate_instance_set", test_negotiate_instance_set},
+        {"instance_capabilities_cache", test_instance_capabilities_cache},
+        {"triple_buffer", test_triple_buffer},
+        {"barrier_batch_images", test_barrier_batch_images},
+        {"barrier_batch_buffers", test_barrier_batch_buffers},
+        {"barrier_batch_read_after_write", test_barrier_batch_read_after_write},
+        {"legacy_barrier_masks", test_legacy_barrier_masks},
+        {"math_matrix_product", test_math_matrix_product},
+        {"math_quaternions", test_math_quaternions},
+        {"math_batch_kernels", test_math_batch_kernels},
+        {"transform_hierarchy", test_transform_hierarchy},
+        {"shadow_tile_packer", test_shadow_tile_packer},
+        {"shadow_atlas", test_shadow_atlas},
+        {"mesh_simplify", test_mesh_simplify},
+        {"mesh_lod_selection", test_mesh_lod_selection},
+        {"meshlets", test_meshlets},
+        {"meshlet_culling", test_meshlet_culling},
+    };
+
+    for (const auto& [name, test]: tests) {
+        if (not filter.empty() and name.find(filter) == std::string::npos) {
+            continue;
+        }
+
+        auto before = failures;
+        try {
+            test();
+        } catch (const std::exception& e) {
+            ++failures;
+            std::cerr << name << ": unexpected exception: " << e.what() << '\n';
+        }
+        std::cout << (failures == before ? "PASS " : "FAIL ") << name << '\n';
+    }
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "scene.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+namespace scene {
+
+// Parent/child transform hierarchy stored so that every parent precedes its
+// children. That lets update() compute world matrices in one forward pass
+// with no recursion or stack, and lets a dirty flag flow down to children
+// by a single look at the parent's flag. Only nodes whose own local
+// transform, or one of whose ancestors', changed since the last update are
+// recomputed.
+class TransformHierarchy {
+public:
+    constexpr static auto NO_PARENT = std::numeric_limits<uint32_t>::max();
+
+    auto size() const -> size_t {
+        return parents.size();
+    }
+
+    auto add(uint32_t parent, const Transform& local) -> uint32_t {
+        if (parent != NO_PARENT and parent >= size()) {
+            throw std::out_of_range("Transform parent must be added before its children");
+        }
+
+        auto node = static_cast<uint32_t>(size());
+        parents.push_back(parent);
+        locals.push_back(local);
+        worlds.push_back(math::Mat4{});
+        dirty.push_back(1);
+        any_dirty = true;
+        return node;
+    }
+
+    void set_local(uint32_t node, const Transform& local) {
+        locals[node] = local;
+        dirty[node] = 1;
+        any_dirty = true;
+    }
+
+    auto local(uint32_t node) const -> const Transform& {
+        return locals[node];
+    }
+
+    auto world(uint32_t node) const -> const math::Mat4& {
+        return worlds[node];
+    }
+
+    auto parent(uint32_t node) const {
+        return parents[node];
+    }
+
+    // Recomputes dirty world matrices and returns how many were updated. If
+    // instances is given, every node's world matrix, recomputed or not, is
+    // stored at instances[node]. Per-frame instance buffers are used in
+    // rotation, so the one being filled has missed the updates made while
+    // the others were current; copying only the recomputed matrices would
+    // leave it stale.
+    auto update(math::Mat4* instances = nullptr) -> size_t {
+        if (not any_dirty) {
+            if (instances) {
+                std::copy(worlds.begin(), worlds.end(), instances);
+            }
+            return 0;
+        }
+
+        auto updated = size_t{0};
+
+        for (auto node = size_t{0}; node < size(); ++node) {
+            auto parent = parents[node];
+
+            if (parent != NO_PARENT) {
+                dirty[node] |= dirty[parent];
+            }
+
+            if (dirty[node]) {
+                if (parent == NO_PARENT) {
+                    worlds[node] = locals[node].matrix();
+                } else {
+                    math::multiply(worlds[parent], locals[node].matrix(), worlds[node]);
+                }
+                ++updated;
+            }
+
+            if (instances) {
+                instances[node] = worlds[node];
+            }
+        }
+
+        std::fill(dirty.begin(), dirty.end(), 0);
+        any_dirty = false;
+        return updated;
+    }
+
+    // Renumbers nodes level by level (roots first, then their children, ...)
+    // so siblings are adjacent and a dirty subtree is a few contiguous runs.
+    // Returns the new index of every old node.
+    auto sort_breadth_first() -> std::vector<uint32_t> {
+        auto children = std::vector<std::vector<uint32_t>>(size());
+        auto order = std::vector<uint32_t>{};
+        order.reserve(size());
+
+        for (auto node = uint32_t{0}; node < size(); ++node) {
+            if (parents[node] == NO_PARENT) {
+                order.push_back(node);
+            } else {
+                children[parents[node]].push_back(node);
+            }
+        }
+
+        for (auto i = size_t{0}; i < order.size(); ++i) {
+            for (auto child: children[order[i]]) {
+                order.push_back(child);
+            }
+        }
+
+        auto remap = std::vector<uint32_t>(size());
+        for (auto i = uint32_t{0}; i < order.size(); ++i) {
+            remap[order[i]] = i;
+        }
+
+        auto sorted = TransformHierarchy{};
+        sorted.parents.reserve(size());
+        for (auto old_node: order) {
+            auto parent = parents[old_node];
+            sorted.parents.push_back(parent == NO_PARENT ? NO_PARENT : remap[parent]);
+            sorted.locals.push_back(locals[old_node]);
+            sorted.worlds.push_back(worlds[old_node]);
+            sorted.dirty.push_back(dirty[old_node]);
+        }
+        sorted.any_dirty = any_dirty;
+
+        *this = std::move(sorted);
+        return remap;
+    }
+
+private:
+    std::vector<uint32_t> parents;
+    std::vector<Transform> locals;
+    std::vector<math::Mat4> worlds;
+    std::vector<uint8_t> dirty;
+    bool any_dirty = false;
+};
+
+}
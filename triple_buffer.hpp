@@ -0,0 +1,44 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+
+// Single-producer/single-consumer triple buffer: the writer always has a
+// private back slot, the reader always has a private front slot, and the
+// middle slot is handed over with one atomic exchange. Neither side ever
+// blocks the other, and the reader always sees the most recent publish.
+template <typename T>
+class TripleBuffer {
+public:
+    auto back() -> T& {
+        return slots[back_index];
+    }
+
+    void publish() {
+        auto previous = middle.exchange(back_index | DIRTY_BIT, std::memory_order_acq_rel);
+        back_index = previous & INDEX_MASK;
+    }
+
+    auto update() -> bool {
+        if ((middle.load(std::memory_order_relaxed) & DIRTY_BIT) == 0) {
+            return false;
+        }
+
+        auto previous = middle.exchange(front_index, std::memory_order_acq_rel);
+        front_index = previous & INDEX_MASK;
+        return true;
+    }
+
+    auto front() const -> const T& {
+        return slots[front_index];
+    }
+
+private:
+    constexpr static auto DIRTY_BIT = 0x4u;
+    constexpr static auto INDEX_MASK = 0x3u;
+
+    std::array<T, 3> slots{};
+    unsigned back_index = 0;
+    std::atomic<unsigned> middle{1};
+    unsigned front_index = 2;
+};